@@ -0,0 +1,130 @@
+#include "Particles/ParticleAlgorithms.h"
+
+#include "Particles/ParticleThreads.h"
+
+#include <SFML/Config.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+namespace particles {
+
+/* AliasTable */
+
+void AliasTable::build(const float *weights, int n) {
+	m_prob.assign(n, 0.0f);
+	m_alias.assign(n, 0);
+	m_totalWeight = 0.0f;
+
+	for (int i = 0; i < n; ++i) {
+		m_totalWeight += std::max(weights[i], 0.0f);
+	}
+	if (n == 0 || m_totalWeight <= 0.0f) {
+		m_prob.clear();
+		m_alias.clear();
+		return;
+	}
+
+	// Scale weights to mean 1, then pair every small entry with a large one
+	std::vector<int> small, large;
+	const float scale = n / m_totalWeight;
+	for (int i = 0; i < n; ++i) {
+		m_prob[i] = std::max(weights[i], 0.0f) * scale;
+		if (m_prob[i] < 1.0f) small.push_back(i); else large.push_back(i);
+	}
+
+	while (!small.empty() && !large.empty()) {
+		int s = small.back();	small.pop_back();
+		int l = large.back();
+		m_alias[s] = l;
+		m_prob[l] -= 1.0f - m_prob[s];
+		if (m_prob[l] < 1.0f) {
+			large.pop_back();
+			small.push_back(l);
+		}
+	}
+
+	// Remaining entries are 1 up to rounding errors
+	for (int i : small) m_prob[i] = 1.0f;
+	for (int i : large) m_prob[i] = 1.0f;
+}
+
+
+/* RadixSorter */
+
+// Maps floats to unsigned integers with the same order, negative numbers have all bits flipped
+static inline unsigned int toRadixKey(float f) {
+	sf::Uint32 u;
+	std::memcpy(&u, &f, sizeof(u));
+	return (u & 0x80000000u) ? ~u : (u | 0x80000000u);
+}
+
+void RadixSorter::sort(const float *keys, const int *indices, int count, int maxThreads) {
+	m_keys.resize(count);
+	m_keysTmp.resize(count);
+	m_indices.resize(count);
+	m_indicesTmp.resize(count);
+
+	for (int i = 0; i < count; ++i) {
+		m_keys[i] = toRadixKey(keys[i]);
+		m_indices[i] = indices ? indices[i] : i;
+	}
+
+	const int minPerThread = 16384;
+	const int blocks = std::max(std::min(maxThreads, count / minPerThread), 1);
+	const int blockSize = (count + blocks - 1) / blocks;
+	m_histograms.resize(256 * blocks);
+
+	for (int shift = 0; shift < 32; shift += 8) {
+		parallelFor(blocks, 1, blocks, [this, shift, count, blockSize](int firstBlock, int lastBlock) {
+			for (int b = firstBlock; b < lastBlock; ++b) {
+				unsigned int *histogram = &m_histograms[256 * b];
+				std::fill(histogram, histogram + 256, 0u);
+
+				const int end = std::min((b + 1) * blockSize, count);
+				for (int i = b * blockSize; i < end; ++i) {
+					histogram[(m_keys[i] >> shift) & 0xff]++;
+				}
+			}
+		});
+
+		// All keys share this digit, the pass wouldn't change the order
+		bool skip = false;
+		for (int digit = 0; digit < 256 && !skip; ++digit) {
+			unsigned int total = 0;
+			for (int b = 0; b < blocks; ++b) {
+				total += m_histograms[256 * b + digit];
+			}
+			skip = (total == static_cast<unsigned int>(count));
+		}
+		if (skip) continue;
+
+		// Exclusive prefix sum, digit major and block minor so the blocks keep their relative order
+		unsigned int sum = 0;
+		for (int digit = 0; digit < 256; ++digit) {
+			for (int b = 0; b < blocks; ++b) {
+				unsigned int n = m_histograms[256 * b + digit];
+				m_histograms[256 * b + digit] = sum;
+				sum += n;
+			}
+		}
+
+		parallelFor(blocks, 1, blocks, [this, shift, count, blockSize](int firstBlock, int lastBlock) {
+			for (int b = firstBlock; b < lastBlock; ++b) {
+				unsigned int *offsets = &m_histograms[256 * b];
+
+				const int end = std::min((b + 1) * blockSize, count);
+				for (int i = b * blockSize; i < end; ++i) {
+					unsigned int dst = offsets[(m_keys[i] >> shift) & 0xff]++;
+					m_keysTmp[dst] = m_keys[i];
+					m_indicesTmp[dst] = m_indices[i];
+				}
+			}
+		});
+
+		m_keys.swap(m_keysTmp);
+		m_indices.swap(m_indicesTmp);
+	}
+}
+
+}
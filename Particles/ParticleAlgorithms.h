@@ -0,0 +1,54 @@
+#pragma once
+
+#include <random>
+#include <vector>
+
+namespace particles {
+
+/* Walker's alias method: constant time sampling from a discrete distribution after linear setup */
+class AliasTable {
+public:
+	void build(const float *weights, int n);
+
+	void build(const std::vector<float> &weights) {
+		build(weights.data(), static_cast<int>(weights.size()));
+	}
+
+	inline int sample() const {
+		// Column and coin need independent draws, rand() has as little as 15 bits on some platforms
+		std::uniform_int_distribution<int> column(0, static_cast<int>(m_prob.size()) - 1);
+		std::uniform_real_distribution<float> coin(0.0f, 1.0f);
+		const int i = column(m_engine);
+		return (coin(m_engine) < m_prob[i]) ? i : m_alias[i];
+	}
+
+	inline bool empty() const { return m_prob.empty(); }
+	inline int size() const { return static_cast<int>(m_prob.size()); }
+	inline float getTotalWeight() const { return m_totalWeight; }
+
+private:
+	std::vector<float> m_prob;
+	std::vector<int> m_alias;
+	float m_totalWeight{ 0.0f };
+	mutable std::mt19937 m_engine;
+};
+
+
+/* Stable LSD radix sort of indices by float keys, 8 bits per pass. Large inputs are split into one block per thread,
+   every block builds its own digit histogram and scatters its own elements */
+class RadixSorter {
+public:
+	// indices == nullptr sorts 0 .. count - 1, the sorted indices are available through getIndices
+	void sort(const float *keys, const int *indices, int count, int maxThreads);
+
+	inline const int *getIndices() const { return m_indices.data(); }
+
+private:
+	std::vector<unsigned int> m_keys;
+	std::vector<unsigned int> m_keysTmp;
+	std::vector<int> m_indices;
+	std::vector<int> m_indicesTmp;
+	std::vector<unsigned int> m_histograms;	// 256 counters per block
+};
+
+}
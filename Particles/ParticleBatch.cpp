@@ -0,0 +1,321 @@
+#include "Particles/ParticleBatch.h"
+
+#include "Particles/ParticleData.h"
+
+#include <SFML/OpenGL.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+namespace particles {
+
+bool ParticleBatch::addSystem(TextureParticleSystem *system) {
+	if (system == nullptr || system->getTexture() == nullptr) return false;
+	if (dynamic_cast<MetaballParticleSystem *>(system) != nullptr) return false;
+	if (std::find(m_systems.begin(), m_systems.end(), system) != m_systems.end()) return true;
+
+	m_systems.push_back(system);
+	m_atlasDirty = true;
+	return true;
+}
+
+void ParticleBatch::removeSystem(TextureParticleSystem *system) {
+	auto it = std::find(m_systems.begin(), m_systems.end(), system);
+	if (it == m_systems.end()) return;
+	detachSystem(system);
+	m_systems.erase(it);
+	m_atlasDirty = true;
+}
+
+void ParticleBatch::clear() {
+	detachSystems();
+	m_systems.clear();
+	m_atlasDirty = true;
+}
+
+void ParticleBatch::buildAtlas() {
+	m_atlasDirty = false;
+	m_atlasValid = false;
+	m_atlasOffsets.clear();
+	m_packedTextures.clear();
+
+	std::vector<const sf::Texture *> textures;
+	for (auto system : m_systems) {
+		const sf::Texture *texture = system->getTexture();
+		m_packedTextures.push_back(texture);
+		if (texture && std::find(textures.begin(), textures.end(), texture) == textures.end()) {
+			textures.push_back(texture);
+		}
+	}
+	if (textures.empty()) return;
+
+	// Shelf packing with the tallest textures first, the atlas is kept roughly square
+	std::sort(textures.begin(), textures.end(), [](const sf::Texture *a, const sf::Texture *b) {
+		return a->getSize().y > b->getSize().y;
+	});
+
+	const unsigned int maxSize = sf::Texture::getMaximumSize();
+	unsigned int area = 0;
+	unsigned int widest = 0;
+	for (auto texture : textures) {
+		unsigned int w = texture->getSize().x + 2 * padding;
+		unsigned int h = texture->getSize().y + 2 * padding;
+		area += w * h;
+		widest = std::max(widest, w);
+	}
+
+	const unsigned int width = std::max(widest, static_cast<unsigned int>(std::ceil(std::sqrt(static_cast<float>(area)))));
+	if (width > maxSize) return;
+
+	std::vector<sf::Vector2u> positions(textures.size());
+	unsigned int x = 0, y = 0, shelfHeight = 0;
+	for (size_t i = 0; i < textures.size(); ++i) {
+		unsigned int w = textures[i]->getSize().x + 2 * padding;
+		unsigned int h = textures[i]->getSize().y + 2 * padding;
+		if (x + w > width) {
+			x = 0;
+			y += shelfHeight;
+			shelfHeight = 0;
+		}
+		positions[i] = sf::Vector2u(x + padding, y + padding);
+		x += w;
+		shelfHeight = std::max(shelfHeight, h);
+	}
+
+	const unsigned int height = y + shelfHeight;
+	if (height > maxSize) return;
+
+	sf::Image image;
+	image.create(width, height, sf::Color::Transparent);
+	bool smooth = false;
+
+	for (size_t i = 0; i < textures.size(); ++i) {
+		const sf::Image source = textures[i]->copyToImage();
+		const sf::Vector2u size = source.getSize();
+		const sf::Vector2u pos = positions[i];
+		if (size.x == 0 || size.y == 0) continue;
+
+		image.copy(source, pos.x, pos.y);
+
+		// Repeat the edge pixels into the padding, so filtering at the border doesn't pick up the neighbours
+		const int pad = static_cast<int>(padding);
+		for (int py = -pad; py < static_cast<int>(size.y) + pad; ++py) {
+			for (int px = -pad; px < static_cast<int>(size.x) + pad; ++px) {
+				int sx = std::min(std::max(px, 0), static_cast<int>(size.x) - 1);
+				int sy = std::min(std::max(py, 0), static_cast<int>(size.y) - 1);
+				if (sx == px && sy == py) continue;
+
+				image.setPixel(pos.x + px, pos.y + py, source.getPixel(sx, sy));
+			}
+		}
+
+		smooth = smooth || textures[i]->isSmooth();
+		m_atlasOffsets[textures[i]] = sf::Vector2f(static_cast<float>(pos.x), static_cast<float>(pos.y));
+	}
+
+	if (!m_atlas.loadFromImage(image)) return;
+	m_atlas.setSmooth(smooth);
+	m_atlasValid = true;
+}
+
+void ParticleBatch::attachSystems() {
+	const bool compact = compactVertices;
+	const sf::Vector2f atlasSize(m_atlas.getSize());
+
+	size_t totalQuads = 0;
+	m_firstQuads.resize(m_systems.size());
+	for (size_t i = 0; i < m_systems.size(); ++i) {
+		m_firstQuads[i] = totalQuads;
+		totalQuads += m_systems[i]->m_particles->count;
+	}
+
+	// Ranges must not move while systems point into them
+	m_vertices.clear();
+	m_compactVertices.clear();
+	if (compact) {
+		m_vertices.shrink_to_fit();
+		m_compactVertices.resize(4 * totalQuads);
+	}
+	else {
+		m_compactVertices.shrink_to_fit();
+		m_vertices.resize(4 * totalQuads);
+	}
+
+	const float scaleX = 65535.f / std::max(atlasSize.x, 1.f);
+	const float scaleY = 65535.f / std::max(atlasSize.y, 1.f);
+
+	for (size_t i = 0; i < m_systems.size(); ++i) {
+		TextureParticleSystem *system = m_systems[i];
+		const size_t first = m_firstQuads[i];
+		const int count = system->m_particles->count;
+
+		// Whole texture for every slot, sprite sheet systems overwrite the slots they draw
+		const sf::Vector2f offset = m_atlasOffsets[system->getTexture()];
+		const sf::Vector2f size(system->getTexture()->getSize());
+		const float left = offset.x, top = offset.y, right = offset.x + size.x, bottom = offset.y + size.y;
+
+		if (compact) {
+			const sf::Uint16 u0 = static_cast<sf::Uint16>(std::min(left * scaleX + 0.5f, 65535.f));
+			const sf::Uint16 v0 = static_cast<sf::Uint16>(std::min(top * scaleY + 0.5f, 65535.f));
+			const sf::Uint16 u1 = static_cast<sf::Uint16>(std::min(right * scaleX + 0.5f, 65535.f));
+			const sf::Uint16 v1 = static_cast<sf::Uint16>(std::min(bottom * scaleY + 0.5f, 65535.f));
+
+			for (int q = 0; q < count; ++q) {
+				CompactVertex *quad = &m_compactVertices[4 * (first + q)];
+				quad[0].texCoords[0] = u0;	quad[0].texCoords[1] = v0;
+				quad[1].texCoords[0] = u1;	quad[1].texCoords[1] = v0;
+				quad[2].texCoords[0] = u1;	quad[2].texCoords[1] = v1;
+				quad[3].texCoords[0] = u0;	quad[3].texCoords[1] = v1;
+			}
+
+			system->m_batchCompactVertices = &m_compactVertices[4 * first];
+			system->m_batchVertices = nullptr;
+		}
+		else {
+			for (int q = 0; q < count; ++q) {
+				sf::Vertex *quad = &m_vertices[4 * (first + q)];
+				quad[0].texCoords = sf::Vector2f(left, top);
+				quad[1].texCoords = sf::Vector2f(right, top);
+				quad[2].texCoords = sf::Vector2f(right, bottom);
+				quad[3].texCoords = sf::Vector2f(left, bottom);
+			}
+
+			system->m_batchVertices = &m_vertices[4 * first];
+			system->m_batchCompactVertices = nullptr;
+		}
+
+		system->m_texCoordOffset = offset;
+		system->m_texCoordSpace = atlasSize;
+		system->m_texCoordsCurrent = false;
+		system->invalidateVertices();
+	}
+
+	m_attached = true;
+	m_attachedCompact = compact;
+}
+
+void ParticleBatch::detachSystems() {
+	for (auto system : m_systems) {
+		detachSystem(system);
+	}
+	m_attached = false;
+}
+
+void ParticleBatch::detachSystem(TextureParticleSystem *system) {
+	if (!system->isBatched()) return;
+
+	system->m_batchVertices = nullptr;
+	system->m_batchCompactVertices = nullptr;
+	system->m_texCoordOffset = sf::Vector2f(0.f, 0.f);
+	system->m_texCoordsCurrent = false;
+	system->invalidateVertices();
+}
+
+void ParticleBatch::appendIndices(TextureParticleSystem *system, size_t firstQuad, size_t &index) {
+	const int count = system->m_drawCount;
+	unsigned int *dst = m_indices.data() + index;
+
+	for (int q = 0; q < count; ++q) {
+		const unsigned int v = static_cast<unsigned int>(4 * (firstQuad + q));
+		dst[6 * q + 0] = v + 0;
+		dst[6 * q + 1] = v + 1;
+		dst[6 * q + 2] = v + 2;
+		dst[6 * q + 3] = v + 0;
+		dst[6 * q + 4] = v + 2;
+		dst[6 * q + 5] = v + 3;
+	}
+
+	index += 6 * std::max(count, 0);
+}
+
+void ParticleBatch::render(sf::RenderTarget &renderTarget) {
+	if (m_systems.empty()) return;
+
+	if (m_packedTextures.size() != m_systems.size()) {
+		m_atlasDirty = true;
+	}
+	for (size_t i = 0; i < m_systems.size() && !m_atlasDirty; ++i) {
+		m_atlasDirty = m_systems[i]->getTexture() != m_packedTextures[i];
+	}
+
+	if (m_atlasDirty) {
+		detachSystems();
+		buildAtlas();
+	}
+
+	if (!m_atlasValid) {
+		for (auto system : m_systems) {
+			system->render(renderTarget);
+		}
+		return;
+	}
+
+	if (!m_attached || m_attachedCompact != compactVertices) {
+		attachSystems();
+	}
+
+	size_t total = 0;
+	for (auto system : m_systems) {
+		system->prepareVertices(renderTarget);
+		total += std::max(system->m_drawCount, 0);
+	}
+	if (total == 0) return;
+
+	// Only the index list is rebuilt per frame, one contiguous range per blend mode with additive systems on top
+	m_indices.resize(6 * total);
+	size_t index = 0;
+	for (size_t i = 0; i < m_systems.size(); ++i) {
+		if (!m_systems[i]->additiveBlendMode) appendIndices(m_systems[i], m_firstQuads[i], index);
+	}
+	const size_t alphaEnd = index;
+	for (size_t i = 0; i < m_systems.size(); ++i) {
+		if (m_systems[i]->additiveBlendMode) appendIndices(m_systems[i], m_firstQuads[i], index);
+	}
+
+	renderTarget.pushGLStates();
+
+	const sf::View &view = renderTarget.getView();
+	const sf::IntRect viewport = renderTarget.getViewport(view);
+	const int top = static_cast<int>(renderTarget.getSize().y) - (viewport.top + viewport.height);
+	glViewport(viewport.left, top, viewport.width, viewport.height);
+
+	glMatrixMode(GL_PROJECTION);
+	glLoadMatrixf(view.getTransform().getMatrix());
+	glMatrixMode(GL_MODELVIEW);
+	glLoadIdentity();
+
+	if (m_attachedCompact) {
+		// Scale the 16 bit texture coordinates down to [0, 1] on top of the matrix SFML sets for the texture
+		sf::Texture::bind(&m_atlas, sf::Texture::Normalized);
+		glMatrixMode(GL_TEXTURE);
+		glScalef(1.f / 65535.f, 1.f / 65535.f, 1.f);
+		glMatrixMode(GL_MODELVIEW);
+
+		const char *data = reinterpret_cast<const char *>(m_compactVertices.data());
+		glVertexPointer(2, GL_FLOAT, sizeof(CompactVertex), data + offsetof(CompactVertex, position));
+		glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(CompactVertex), data + offsetof(CompactVertex, color));
+		glTexCoordPointer(2, GL_UNSIGNED_SHORT, sizeof(CompactVertex), data + offsetof(CompactVertex, texCoords));
+	}
+	else {
+		sf::Texture::bind(&m_atlas, sf::Texture::Pixels);
+
+		const char *data = reinterpret_cast<const char *>(m_vertices.data());
+		glVertexPointer(2, GL_FLOAT, sizeof(sf::Vertex), data + offsetof(sf::Vertex, position));
+		glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(sf::Vertex), data + offsetof(sf::Vertex, color));
+		glTexCoordPointer(2, GL_FLOAT, sizeof(sf::Vertex), data + offsetof(sf::Vertex, texCoords));
+	}
+
+	if (alphaEnd > 0) {
+		glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(alphaEnd), GL_UNSIGNED_INT, m_indices.data());
+	}
+
+	if (index > alphaEnd) {
+		TextureParticleSystem::setAdditiveBlending();
+		glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(index - alphaEnd), GL_UNSIGNED_INT, m_indices.data() + alphaEnd);
+	}
+
+	renderTarget.popGLStates();
+}
+
+}
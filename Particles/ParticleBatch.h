@@ -0,0 +1,63 @@
+#pragma once
+
+#include <SFML/Graphics.hpp>
+
+#include "Particles/ParticleSystem.h"
+
+#include <map>
+#include <vector>
+
+namespace particles {
+
+/* Renders many textured particle systems with one draw call per blend mode. Their textures are packed into a shared
+   atlas and every system gets a fixed range of the batch's vertex array, which it builds its quads into directly.
+   Texture coordinates in atlas space are written once when the ranges are handed out.
+   Systems are still updated on their own, only rendering goes through the batch: render() of a registered system
+   draws nothing. Remove systems from the batch before destroying them. */
+class ParticleBatch {
+public:
+	ParticleBatch() {}
+	~ParticleBatch() { detachSystems(); }
+
+	ParticleBatch(const ParticleBatch &) = delete;
+	ParticleBatch &operator=(const ParticleBatch &) = delete;
+
+	bool addSystem(TextureParticleSystem *system);	// false for systems that can't be batched, e.g. metaballs with their own pass
+	void removeSystem(TextureParticleSystem *system);
+	void clear();
+
+	inline void invalidateAtlas() { m_atlasDirty = true; }	// repack after the contents of a registered texture changed
+
+	void render(sf::RenderTarget &renderTarget);
+
+	inline const sf::Texture &getAtlas() const { return m_atlas; }
+	inline size_t getNumberSystems() const { return m_systems.size(); }
+
+public:
+	unsigned int padding{ 2 };	// Border around every texture in the atlas, filled with its edge pixels against bleeding
+	bool compactVertices{ false };	// CompactVertex layout for all systems in the batch, their own setting is ignored
+
+protected:
+	void buildAtlas();
+	void attachSystems();	// hand every system its vertex range and write the atlas texture coordinates
+	void detachSystems();	// back to the systems' own vertex storage
+	void detachSystem(TextureParticleSystem *system);
+	void appendIndices(TextureParticleSystem *system, size_t firstQuad, size_t &index);	// triangles of the system's drawn quads
+
+protected:
+	std::vector<TextureParticleSystem *> m_systems;
+	std::vector<const sf::Texture *> m_packedTextures;	// Texture of every system when the atlas was built
+	std::map<const sf::Texture *, sf::Vector2f> m_atlasOffsets;
+	sf::Texture m_atlas;
+	bool m_atlasDirty{ true };
+	bool m_atlasValid{ false };	// False if the textures didn't fit, systems are then rendered one by one
+
+	bool m_attached{ false };	// Systems build into m_vertices or m_compactVertices
+	bool m_attachedCompact{ false };
+	std::vector<size_t> m_firstQuads;	// Start of every system's range, maxCount quads each
+	std::vector<sf::Vertex> m_vertices;
+	std::vector<CompactVertex> m_compactVertices;
+	std::vector<unsigned int> m_indices;	// Rebuilt every frame for the quads the systems drew
+};
+
+}
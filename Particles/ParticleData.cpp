@@ -2,34 +2,64 @@
 
 namespace particles {
 	
-ParticleData::ParticleData(int maxSize) : count(maxSize), countAlive(0) {
+ParticleData::ParticleData(int maxSize) : count(maxSize), countAlive(0), history(nullptr), historyLength(0), historyHead(0), boundsValid(false), eventCount(0), eventFrame(0) {
 	pos = new sf::Vector2f[maxSize];
+	prevPos = new sf::Vector2f[maxSize];
 	vel = new sf::Vector2f[maxSize];
 	acc = new sf::Vector2f[maxSize];
+	prevAcc = new sf::Vector2f[maxSize];
+	damping = new float[maxSize];
 	time = new sf::Vector3f[maxSize];
+	spawnTime = new float[maxSize];
 	size = new sf::Vector3f[maxSize];
 	angle = new sf::Vector3f[maxSize];
 	col = new sf::Color[maxSize];
 	startCol = new sf::Color[maxSize];
 	endCol = new sf::Color[maxSize];
 	texCoords = new sf::IntRect[maxSize];
+	texCoordsDirty = new bool[maxSize];
 	frame = new int[maxSize];
 	frameTimer = new float[maxSize];
+	events = new ParticleEvent[maxSize];
+
+	std::fill(damping, damping + maxSize, 0.0f);	// Only written by DampingGenerator
+	std::fill(texCoordsDirty, texCoordsDirty + maxSize, true);
+	resetBounds();
 }
 
 ParticleData::~ParticleData() {
-	delete pos;
-	delete vel;
-	delete acc;
-	delete time;
-	delete size;
-	delete angle;
-	delete col;
-	delete startCol;
-	delete endCol;
-	delete texCoords;
-	delete frame;
-	delete frameTimer;
+	delete[] pos;
+	delete[] prevPos;
+	delete[] vel;
+	delete[] acc;
+	delete[] prevAcc;
+	delete[] damping;
+	delete[] time;
+	delete[] spawnTime;
+	delete[] size;
+	delete[] angle;
+	delete[] col;
+	delete[] startCol;
+	delete[] endCol;
+	delete[] texCoords;
+	delete[] texCoordsDirty;
+	delete[] frame;
+	delete[] frameTimer;
+	delete[] events;
+	delete[] history;
+}
+
+void ParticleData::enableHistory(int length) {
+	delete[] history;
+	historyLength = std::max(length, 1);
+	historyHead = 0;
+	history = new sf::Vector2f[count * historyLength];
+
+	for (int i = 0; i < countAlive; ++i) {
+		for (int k = 0; k < historyLength; ++k) {
+			history[i * historyLength + k] = pos[i];
+		}
+	}
 }
 
 void ParticleData::kill(int id) {
@@ -41,17 +71,26 @@ void ParticleData::kill(int id) {
 
 void ParticleData::swapData(int id1, int id2) {
 	std::swap(pos[id1], pos[id2]);
+	std::swap(prevPos[id1], prevPos[id2]);
 	std::swap(vel[id1], vel[id2]);
 	std::swap(acc[id1], acc[id2]);
+	std::swap(prevAcc[id1], prevAcc[id2]);
+	std::swap(damping[id1], damping[id2]);
 	std::swap(time[id1], time[id2]);
+	std::swap(spawnTime[id1], spawnTime[id2]);
 	std::swap(size[id1], size[id2]);
 	std::swap(angle[id1], angle[id2]);
 	std::swap(col[id1], col[id2]);
 	std::swap(startCol[id1], startCol[id2]);
 	std::swap(endCol[id1], endCol[id2]);
 	std::swap(texCoords[id1], texCoords[id2]);
+	texCoordsDirty[id1] = texCoordsDirty[id2] = true;
 	std::swap(frame[id1], frame[id2]);
 	std::swap(frameTimer[id1], frameTimer[id2]);
+
+	if (history) {
+		std::swap_ranges(history + id1 * historyLength, history + (id1 + 1) * historyLength, history + id2 * historyLength);
+	}
 }
 
 }
\ No newline at end of file
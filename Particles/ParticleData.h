@@ -2,8 +2,23 @@
 
 #include <SFML/Graphics.hpp>
 
+#include <algorithm>
+#include <cfloat>
+
 namespace particles {
 
+/* Something that happened to a particle during an update, consumed e.g. by EventSpawner */
+struct ParticleEvent {
+	enum Type {
+		Death = 1 << 0,
+		Collision = 1 << 1
+	};
+
+	sf::Vector2f pos;
+	sf::Vector2f vel;	// Velocity at death, outgoing velocity after a bounce
+	int type;
+};
+
 class ParticleData {
 public:
 	explicit ParticleData(int maxCount);
@@ -15,22 +30,78 @@ public:
 	void kill(int id);
 	void swapData(int id1, int id2);
 
+	inline void addEvent(int id, ParticleEvent::Type type) {
+		if (eventCount < count) events[eventCount++] = { pos[id], vel[id], type };
+	}
+
+	void enableHistory(int length);	// Allocates the position history ring buffers
+
+	inline sf::Vector2f &getHistory(int id, int age) {	// age 0 is the latest captured position
+		return history[id * historyLength + (historyHead - age + historyLength) % historyLength];
+	}
+
+	inline void clearEvents() {
+		eventCount = 0;
+		eventFrame++;
+	}
+
+	static constexpr float boundsExtent = 0.7072f;	// Extent of a particle quad around its position per unit of size, half its diagonal
+
+	inline void resetBounds() {
+		boundsMin = sf::Vector2f(FLT_MAX, FLT_MAX);
+		boundsMax = sf::Vector2f(-FLT_MAX, -FLT_MAX);
+	}
+
+	inline void expandBounds(const sf::Vector2f &p, float radius) {
+		boundsMin.x = std::min(boundsMin.x, p.x - radius);	boundsMin.y = std::min(boundsMin.y, p.y - radius);
+		boundsMax.x = std::max(boundsMax.x, p.x + radius);	boundsMax.y = std::max(boundsMax.y, p.y + radius);
+	}
+
+	// For updaters that move particles after the integration pass stored the bounds: covers the new position and one step from it
+	inline void expandBoundsMoved(int id, float dt) {
+		const float radius = boundsExtent * size[id].x;
+		expandBounds(pos[id], radius);
+		expandBounds(pos[id] + dt * vel[id], radius);
+	}
+
+	inline bool boundsOverlap(const sf::Vector2f &lo, const sf::Vector2f &hi) const {
+		return countAlive > 0 && lo.x <= boundsMax.x && hi.x >= boundsMin.x && lo.y <= boundsMax.y && hi.y >= boundsMin.y;
+	}
+
 public:
 	sf::Vector2f *pos;        // Current position
+	sf::Vector2f *prevPos;    // Position before the last simulation step, used for interpolation
 	sf::Vector2f *vel;        // Current velocity
 	sf::Vector2f *acc;        // Current acceleration
+	sf::Vector2f *prevAcc;    // Acceleration of the last step for velocity Verlet, x is FLT_MAX before the first step
+	float        *damping;    // Exponential velocity damping per second
 	sf::Vector3f *time;       // x: remaining time to live,   y: time to live,    z: interpolation value in [0, 1] of lifetime
+	float        *spawnTime;  // Simulation time at which the particle was emitted
 	sf::Vector3f *size;       // x: current size,             y: start size,      z: end size
 	sf::Vector3f *angle;	  // x: current angle,            y: start rotation,  z: end rotation
 	sf::Color    *col;        // Current color
 	sf::Color    *startCol;   // Start color
 	sf::Color    *endCol;     // End color
 	sf::IntRect  *texCoords;  // Texture coordinates inside spritesheet
+	bool         *texCoordsDirty; // texCoords changed or the slot got a different particle since the vertices were written
 	int          *frame;	  // Frame index for animation
 	float        *frameTimer; // Accumulator for animation
 
 	int           count;
 	int           countAlive;
+
+	sf::Vector2f *history;    // Past positions, historyLength per particle, nullptr unless enabled
+	int           historyLength;
+	int           historyHead;  // Slot of the latest capture, shared by all particles
+
+	sf::Vector2f  boundsMin;   // Bounding box of the alive particles including their size, their position before the
+	sf::Vector2f  boundsMax;   // last step and the distance they move in the next one, only grows between steps.
+	                           // Updaters that move particles after the integration pass grow it with expandBoundsMoved
+	bool          boundsValid; // Set when the integration pass rebuilt the bounds during the current step
+
+	ParticleEvent *events;     // Events since the last update started, never more than count
+	int           eventCount;
+	unsigned int  eventFrame;  // Incremented whenever the events are cleared
 };
 
 }
\ No newline at end of file
@@ -0,0 +1,129 @@
+#include "Particles/ParticleEmission.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace particles {
+
+void EmissionSchedule::addBurst(float time, int count, int cycles, float interval) {
+	m_bursts.push_back({ time, count, cycles, interval });
+}
+
+void EmissionSchedule::addRateKey(float time, float rate) {
+	RateKey key{ time, rate };
+	auto it = std::upper_bound(m_rateKeys.begin(), m_rateKeys.end(), key, [](const RateKey &a, const RateKey &b) { return a.time < b.time; });
+	m_rateKeys.insert(it, key);
+}
+
+void EmissionSchedule::clear() {
+	m_bursts.clear();
+	m_rateKeys.clear();
+	restart();
+}
+
+void EmissionSchedule::restart() {
+	m_time = 0.0f;
+	m_rateAccumulator = 0.0f;
+}
+
+int EmissionSchedule::advance(float dt) {
+	float t0 = m_time - delay;
+	float t1 = t0 + dt;
+	m_time += dt;
+
+	if (t1 <= 0.0f || duration <= 0.0f) return 0;
+	t0 = std::max(t0, 0.0f);
+
+	float bursts = 0.0f;
+	float rate = 0.0f;
+
+	if (looping) {
+		// Split the interval at loop boundaries and evaluate each piece in local timeline time
+		float loop = std::floor(t0 / duration);
+		while (t0 < t1) {
+			float loopEnd = (loop + 1.0f) * duration;
+			float end = std::min(t1, loopEnd);
+			float offset = loop * duration;
+			bursts += countBursts(t0 - offset, end - offset);
+			rate += integrateRate(t0 - offset, end - offset);
+			t0 = end;
+			loop += 1.0f;
+		}
+
+		// Keep the clock bounded so precision doesn't degrade over long sessions
+		if (m_time - delay > duration) {
+			m_time = delay + std::fmod(m_time - delay, duration);
+		}
+	}
+	else {
+		t1 = std::min(t1, duration);
+		if (t0 >= t1) return 0;
+		bursts = countBursts(t0, t1);
+		rate = integrateRate(t0, t1);
+	}
+
+	m_rateAccumulator += rate;
+	int fromRate = static_cast<int>(m_rateAccumulator);
+	m_rateAccumulator -= fromRate;
+
+	return static_cast<int>(bursts) + fromRate;
+}
+
+float EmissionSchedule::countBursts(float t0, float t1) const {
+	float total = 0.0f;
+
+	for (const Burst &b : m_bursts) {
+		if (b.interval <= 0.0f || b.cycles == 1) {
+			if (b.time >= t0 && b.time < t1) total += b.count;
+			continue;
+		}
+
+		// Bursts happen at b.time + k * interval, count all k that fall into [t0, t1)
+		int first = std::max(static_cast<int>(std::ceil((t0 - b.time) / b.interval)), 0);
+		int last = static_cast<int>(std::ceil((t1 - b.time) / b.interval)) - 1;
+		if (b.cycles > 0) {
+			last = std::min(last, b.cycles - 1);
+		}
+
+		if (last >= first) {
+			total += static_cast<float>(b.count) * (last - first + 1);
+		}
+	}
+
+	return total;
+}
+
+float EmissionSchedule::rateAt(float t) const {
+	if (t <= m_rateKeys.front().time) return m_rateKeys.front().rate;
+	if (t >= m_rateKeys.back().time) return m_rateKeys.back().rate;
+
+	for (size_t k = 1; k < m_rateKeys.size(); ++k) {
+		const RateKey &a = m_rateKeys[k - 1];
+		const RateKey &b = m_rateKeys[k];
+		if (t < b.time) {
+			float alpha = (t - a.time) / (b.time - a.time);
+			return a.rate + alpha * (b.rate - a.rate);
+		}
+	}
+
+	return m_rateKeys.back().rate;
+}
+
+float EmissionSchedule::integrateRate(float t0, float t1) const {
+	if (m_rateKeys.empty()) return 0.0f;
+
+	// Trapezoidal integration is exact for a piecewise linear curve when split at the keys
+	float total = 0.0f;
+	float a = t0;
+	for (const RateKey &key : m_rateKeys) {
+		if (key.time <= a) continue;
+		if (key.time >= t1) break;
+		total += 0.5f * (rateAt(a) + rateAt(key.time)) * (key.time - a);
+		a = key.time;
+	}
+	total += 0.5f * (rateAt(a) + rateAt(t1)) * (t1 - a);
+
+	return total;
+}
+
+}
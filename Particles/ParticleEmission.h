@@ -0,0 +1,54 @@
+#pragma once
+
+#include <SFML/Graphics.hpp>
+
+namespace particles {
+
+/* Timeline of emission bursts and rate curves, evaluated to a single particle count per step */
+class EmissionSchedule {
+public:
+	struct Burst {
+		float time;		// Start time inside the timeline
+		int count;		// Particles per burst
+		int cycles;		// Number of bursts, 0 repeats until the end of the timeline
+		float interval;	// Time between two bursts
+	};
+
+	struct RateKey {
+		float time;
+		float rate;		// Particles per second, linearly interpolated between keys
+	};
+
+	EmissionSchedule() {}
+	~EmissionSchedule() {}
+
+	int advance(float dt);	// Number of particles to emit during the next dt seconds
+
+	void addBurst(float time, int count, int cycles = 1, float interval = 0.0f);
+	void addRateKey(float time, float rate);
+
+	void clear();
+	void restart();
+
+	inline bool empty() const { return m_bursts.empty() && m_rateKeys.empty(); }
+	inline bool isFinished() const { return !looping && m_time >= delay + duration; }
+
+public:
+	float delay{ 0.0f };	// Time before the timeline starts
+	float duration{ 1.0f };	// Length of the timeline
+	bool looping{ false };	// Restart the timeline after duration
+
+protected:
+	float countBursts(float t0, float t1) const;
+	float integrateRate(float t0, float t1) const;
+	float rateAt(float t) const;
+
+protected:
+	std::vector<Burst> m_bursts;
+	std::vector<RateKey> m_rateKeys;	// Sorted by time
+
+	float m_time{ 0.0f };	// Time since start, including delay
+	float m_rateAccumulator{ 0.0f };
+};
+
+}
@@ -93,6 +93,15 @@ void AimedVelocityGenerator::generate(ParticleData *data, int startId, int endId
 }
 
 
+/* Damping Generators */
+
+void DampingGenerator::generate(ParticleData *data, int startId, int endId) {
+	for (int i = startId; i < endId; ++i) {
+		data->damping[i] = randomFloat(minDamping, maxDamping);
+	}
+}
+
+
 /* Time Generators */
 
 void TimeGenerator::generate(ParticleData *data, int startId, int endId) {
@@ -150,6 +150,21 @@ public:
 };
 
 
+/* Damping Generators */
+
+class DampingGenerator : public ParticleGenerator {
+public:
+	DampingGenerator() {}
+	~DampingGenerator() {}
+
+	void generate(ParticleData *data, int startId, int endId);
+
+public:
+	float minDamping{ 0.0f };
+	float maxDamping{ 0.0f };
+};
+
+
 /* Time Generators */
 
 class TimeGenerator : public ParticleGenerator {
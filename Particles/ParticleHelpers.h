@@ -1,6 +1,7 @@
 #pragma once
 
 #include <SFML/Graphics.hpp>
+#include <algorithm>
 #include <cmath>
 
 namespace particles {
@@ -66,6 +67,35 @@ inline float dot(const sf::Vector2f &a, const sf::Vector2f &b) {
 	return a.x * b.x + a.y * b.y;
 }
 
+// Bilinear lookup in a vector grid stored as separate x and y planes, gx and gy are given in grid units
+inline sf::Vector2f sampleGrid(const float *gridX, const float *gridY, int width, int height, float gx, float gy, bool wrap) {
+	if (wrap) {
+		gx -= std::floor(gx / width) * width;
+		gy -= std::floor(gy / height) * height;
+	}
+	else {
+		gx = std::min(std::max(gx, 0.0f), static_cast<float>(width - 1));
+		gy = std::min(std::max(gy, 0.0f), static_cast<float>(height - 1));
+	}
+
+	int x0 = std::min(static_cast<int>(gx), width - 1);
+	int y0 = std::min(static_cast<int>(gy), height - 1);
+	int x1 = wrap ? (x0 + 1) % width : std::min(x0 + 1, width - 1);
+	int y1 = wrap ? (y0 + 1) % height : std::min(y0 + 1, height - 1);
+	float fx = gx - x0;
+	float fy = gy - y0;
+
+	int i00 = y0 * width + x0;	int i10 = y0 * width + x1;
+	int i01 = y1 * width + x0;	int i11 = y1 * width + x1;
+
+	float x0y = gridX[i00] + fx * (gridX[i10] - gridX[i00]);
+	float x1y = gridX[i01] + fx * (gridX[i11] - gridX[i01]);
+	float y0y = gridY[i00] + fx * (gridY[i10] - gridY[i00]);
+	float y1y = gridY[i01] + fx * (gridY[i11] - gridY[i01]);
+
+	return { x0y + fy * (x1y - x0y), y0y + fy * (y1y - y0y) };
+}
+
 inline float lerpFloat(float a, float b, float alpha) {
 	return a * (1.0f - alpha) + b * alpha;
 }
@@ -79,4 +109,4 @@ inline sf::Color lerpColor(const sf::Color &c1, const sf::Color &c2, float alpha
 	return sf::Color(r, g, b, a);
 }
 
-}
\ No newline at end of file
+}
@@ -22,6 +22,10 @@ void BoxSpawner::spawn(ParticleData *data, int startId, int endId) {
 	}
 }
 
+float BoxSpawner::getMeasure() const {
+	return size.x * size.y;
+}
+
 void CircleSpawner::spawn(ParticleData *data, int startId, int endId) {
 	for (int i = startId; i < endId; ++i) {
 		float phi = randomFloat(0.0f, M_PI * 2.0f);
@@ -30,6 +34,12 @@ void CircleSpawner::spawn(ParticleData *data, int startId, int endId) {
 	}
 }
 
+float CircleSpawner::getMeasure() const {
+	// Ramanujan's approximation of the ellipse circumference
+	float a = radius.x, b = radius.y;
+	return M_PI * (3.0f * (a + b) - std::sqrt((3.0f * a + b) * (a + 3.0f * b)));
+}
+
 void DiskSpawner::spawn(ParticleData *data, int startId, int endId) {
 	for (int i = startId; i < endId; ++i) {
 		float phi = randomFloat(0.0f, M_PI * 2.0f);
@@ -39,4 +49,405 @@ void DiskSpawner::spawn(ParticleData *data, int startId, int endId) {
 	}
 }
 
+float DiskSpawner::getMeasure() const {
+	return M_PI * radius.x * radius.y;
+}
+
+void PoissonDiskSpawner::generateTile(int numPoints) {
+	// Mitchell's best candidate algorithm with toroidal distances: each new point is the candidate
+	// farthest away from all previous ones, so points are evenly spread and the tile wraps seamlessly
+	const int candidates = 10;
+	m_tile.clear();
+	m_tile.reserve(numPoints);
+	m_cursor = 0;
+
+	for (int n = 0; n < numPoints; ++n) {
+		sf::Vector2f best;
+		float bestDist = -1.0f;
+
+		for (int c = 0; c < candidates; ++c) {
+			sf::Vector2f p{ randomFloat(0.0f, 1.0f), randomFloat(0.0f, 1.0f) };
+			float minDist = 2.0f;
+
+			for (const sf::Vector2f &q : m_tile) {
+				float dx = std::abs(p.x - q.x);	dx = std::min(dx, 1.0f - dx);
+				float dy = std::abs(p.y - q.y);	dy = std::min(dy, 1.0f - dy);
+				minDist = std::min(minDist, dx * dx + dy * dy);
+			}
+
+			if (minDist > bestDist) {
+				bestDist = minDist;
+				best = p;
+			}
+		}
+
+		m_tile.push_back(best);
+	}
+}
+
+float PoissonDiskSpawner::getMeasure() const {
+	return size.x * size.y;
+}
+
+void PoissonDiskSpawner::spawn(ParticleData *data, int startId, int endId) {
+	if (m_tile.empty()) {
+		generateTile(std::max(tilePoints, 1));
+	}
+
+	const int n = static_cast<int>(m_tile.size());
+	const sf::Vector2f corner = center - 0.5f * size;
+	const float tile = std::max(tileSize, 1e-3f);
+
+	// The copies cover a whole number of tiles, so wrapping the offset across them stays seamless;
+	// points of the last row/column that fall past the box are skipped
+	const int copiesX = std::max(static_cast<int>(std::ceil(size.x / tile)), 1);
+	const int copiesY = std::max(static_cast<int>(std::ceil(size.y / tile)), 1);
+	const int copies = copiesX * copiesY;
+	const int cycle = n * copies;
+	const sf::Vector2f extent{ copiesX * tile, copiesY * tile };
+
+	if (m_cursor >= cycle) m_cursor = 0;
+
+	for (int i = startId; i < endId; ++i) {
+		sf::Vector2f p;
+
+		for (int tries = 0; tries < cycle; ++tries) {
+			if (m_cursor == 0) {
+				m_offset = sf::Vector2f(randomFloat(0.0f, extent.x), randomFloat(0.0f, extent.y));
+			}
+
+			const int copy = m_cursor % copies;
+			const sf::Vector2f &q = m_tile[m_cursor / copies];
+			p.x = (copy % copiesX + q.x) * tile + m_offset.x;
+			p.y = (copy / copiesX + q.y) * tile + m_offset.y;
+			if (p.x >= extent.x) p.x -= extent.x;
+			if (p.y >= extent.y) p.y -= extent.y;
+
+			if (++m_cursor == cycle) m_cursor = 0;
+			if (p.x < size.x && p.y < size.y) break;
+		}
+
+		data->pos[i] = { corner.x + std::min(p.x, size.x), corner.y + std::min(p.y, size.y) };
+	}
+}
+
+void ImageSpawner::setImage(const sf::Image &image) {
+	const sf::Vector2u size = image.getSize();
+	const sf::Vector2f half{ 0.5f * size.x, 0.5f * size.y };
+
+	std::vector<float> weights;
+	m_pixels.clear();
+
+	for (unsigned int y = 0; y < size.y; ++y) {
+		for (unsigned int x = 0; x < size.x; ++x) {
+			sf::Uint8 alpha = image.getPixel(x, y).a;
+			if (alpha <= alphaThreshold) continue;
+
+			m_pixels.push_back(sf::Vector2f(x - half.x, y - half.y));
+			weights.push_back(static_cast<float>(alpha));
+		}
+	}
+
+	m_table.build(weights);
+}
+
+float ImageSpawner::getMeasure() const {
+	return scale * scale * static_cast<float>(m_pixels.size());
+}
+
+void ImageSpawner::spawn(ParticleData *data, int startId, int endId) {
+	if (m_table.empty()) {
+		for (int i = startId; i < endId; ++i) {
+			data->pos[i] = center;
+		}
+		return;
+	}
+
+	for (int i = startId; i < endId; ++i) {
+		sf::Vector2f p = m_pixels[m_table.sample()];
+		if (jitter) {
+			p += sf::Vector2f(randomFloat(0.0f, 1.0f), randomFloat(0.0f, 1.0f));
+		}
+		else {
+			p += sf::Vector2f(0.5f, 0.5f);
+		}
+		data->pos[i] = center + scale * p;
+	}
+}
+
+static float cross(const sf::Vector2f &a, const sf::Vector2f &b) {
+	return a.x * b.y - a.y * b.x;
+}
+
+static float length(const sf::Vector2f &a) {
+	return std::sqrt(a.x * a.x + a.y * a.y);
+}
+
+void PolygonSpawner::setPolygon(const std::vector<sf::Vector2f> &points) {
+	m_triangles.clear();
+	m_dirty = true;
+
+	const int n = static_cast<int>(points.size());
+	if (n < 3) return;
+
+	// Work on a counter-clockwise copy of the vertex indices
+	float area = 0.0f;
+	for (int i = 0; i < n; ++i) {
+		area += cross(points[i], points[(i + 1) % n]);
+	}
+
+	std::vector<int> remaining(n);
+	for (int i = 0; i < n; ++i) {
+		remaining[i] = (area >= 0.0f) ? i : n - 1 - i;
+	}
+
+	int guard = 2 * n;
+	int i = 0;
+	while (remaining.size() > 3 && guard > 0) {
+		const int m = static_cast<int>(remaining.size());
+		const sf::Vector2f &a = points[remaining[(i + m - 1) % m]];
+		const sf::Vector2f &b = points[remaining[i % m]];
+		const sf::Vector2f &c = points[remaining[(i + 1) % m]];
+
+		bool ear = cross(b - a, c - b) > 0.0f;
+		for (int k = 0; ear && k < m; ++k) {
+			const sf::Vector2f &p = points[remaining[k]];
+			if (&p == &a || &p == &b || &p == &c) continue;
+			if (cross(b - a, p - a) >= 0.0f && cross(c - b, p - b) >= 0.0f && cross(a - c, p - c) >= 0.0f) {
+				ear = false;
+			}
+		}
+
+		if (ear) {
+			m_triangles.push_back(a);
+			m_triangles.push_back(b);
+			m_triangles.push_back(c);
+			remaining.erase(remaining.begin() + i % m);
+			guard = 2 * static_cast<int>(remaining.size());
+		}
+		else {
+			i++;
+			guard--;
+		}
+		i %= static_cast<int>(remaining.size());
+	}
+
+	// Also taken when the polygon is degenerate or self-intersecting and no ear is left
+	for (size_t k = 1; k + 1 < remaining.size(); ++k) {
+		m_triangles.push_back(points[remaining[0]]);
+		m_triangles.push_back(points[remaining[k]]);
+		m_triangles.push_back(points[remaining[k + 1]]);
+	}
+}
+
+void PolygonSpawner::addTriangle(const sf::Vector2f &a, const sf::Vector2f &b, const sf::Vector2f &c) {
+	m_triangles.push_back(a);
+	m_triangles.push_back(b);
+	m_triangles.push_back(c);
+	m_dirty = true;
+}
+
+void PolygonSpawner::clear() {
+	m_triangles.clear();
+	m_dirty = true;
+}
+
+void PolygonSpawner::buildTable() const {
+	const int n = static_cast<int>(numTriangles());
+	std::vector<float> areas(n);
+	for (int t = 0; t < n; ++t) {
+		const sf::Vector2f *tri = &m_triangles[3 * t];
+		areas[t] = 0.5f * std::abs(cross(tri[1] - tri[0], tri[2] - tri[0]));
+	}
+	m_table.build(areas);
+	m_dirty = false;
+}
+
+float PolygonSpawner::getMeasure() const {
+	if (m_dirty) {
+		buildTable();
+	}
+	return m_table.getTotalWeight();
+}
+
+void PolygonSpawner::spawn(ParticleData *data, int startId, int endId) {
+	if (m_dirty) {
+		buildTable();
+	}
+
+	if (m_table.empty()) {
+		for (int i = startId; i < endId; ++i) {
+			data->pos[i] = center;
+		}
+		return;
+	}
+
+	for (int i = startId; i < endId; ++i) {
+		const sf::Vector2f *tri = &m_triangles[3 * m_table.sample()];
+		float u = randomFloat(0.0f, 1.0f);
+		float v = randomFloat(0.0f, 1.0f);
+		if (u + v > 1.0f) {
+			u = 1.0f - u;
+			v = 1.0f - v;
+		}
+		data->pos[i] = center + tri[0] + u * (tri[1] - tri[0]) + v * (tri[2] - tri[0]);
+	}
+}
+
+void PolylineSpawner::setPoints(const std::vector<sf::Vector2f> &points) {
+	m_points = points;
+	m_dirty = true;
+}
+
+void PolylineSpawner::buildTable() const {
+	m_closed = closed && m_points.size() > 2;
+	const int n = static_cast<int>(m_points.size());
+	const int segments = m_closed ? n : n - 1;
+
+	std::vector<float> lengths(std::max(segments, 0));
+	for (int s = 0; s < segments; ++s) {
+		lengths[s] = length(m_points[(s + 1) % n] - m_points[s]);
+	}
+	m_table.build(lengths);
+	m_dirty = false;
+}
+
+float PolylineSpawner::getMeasure() const {
+	if (isDirty()) {
+		buildTable();
+	}
+	return m_table.getTotalWeight();
+}
+
+void PolylineSpawner::spawn(ParticleData *data, int startId, int endId) {
+	if (isDirty()) {
+		buildTable();
+	}
+
+	if (m_table.empty()) {
+		sf::Vector2f p = m_points.empty() ? center : center + m_points[0];
+		for (int i = startId; i < endId; ++i) {
+			data->pos[i] = p;
+		}
+		return;
+	}
+
+	const int n = static_cast<int>(m_points.size());
+	for (int i = startId; i < endId; ++i) {
+		int s = m_table.sample();
+		const sf::Vector2f &a = m_points[s];
+		const sf::Vector2f &b = m_points[(s + 1) % n];
+		data->pos[i] = center + a + randomFloat(0.0f, 1.0f) * (b - a);
+	}
+}
+
+void SplineSpawner::setControlPoints(const std::vector<sf::Vector2f> &points) {
+	const int n = static_cast<int>(points.size());
+	if (n < 3) {
+		setPoints(points);
+		return;
+	}
+
+	const int segments = closed ? n : n - 1;
+	const int samples = std::max(samplesPerSegment, 1);
+	std::vector<sf::Vector2f> curve;
+	curve.reserve(segments * samples + 1);
+
+	for (int s = 0; s < segments; ++s) {
+		// Neighbouring control points, clamped at the ends of open curves
+		const sf::Vector2f &p0 = points[closed ? (s + n - 1) % n : std::max(s - 1, 0)];
+		const sf::Vector2f &p1 = points[s];
+		const sf::Vector2f &p2 = points[(s + 1) % n];
+		const sf::Vector2f &p3 = points[closed ? (s + 2) % n : std::min(s + 2, n - 1)];
+
+		for (int k = 0; k < samples; ++k) {
+			float t = k / static_cast<float>(samples);
+			float t2 = t * t;
+			float t3 = t2 * t;
+			curve.push_back(0.5f * ((2.0f * p1) + (p2 - p0) * t + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * t2 + (3.0f * p1 - p0 - 3.0f * p2 + p3) * t3));
+		}
+	}
+
+	// Closed curves wrap around to the first sample through the closed polyline
+	if (!closed) {
+		curve.push_back(points[n - 1]);
+	}
+
+	setPoints(curve);
+}
+
+int ParticleSystemSpawner::getEmitCount(float dt) {
+	if (source == nullptr || emitRate <= 0.0f) return 0;
+
+	m_dt += emitRate * source->countAlive * dt;
+	int count = static_cast<int>(m_dt);
+	m_dt -= count;
+
+	return count;
+}
+
+void ParticleSystemSpawner::spawn(ParticleData *data, int startId, int endId) {
+	const int sourceCount = (source != nullptr) ? source->countAlive : 0;
+	if (sourceCount == 0) {
+		for (int i = startId; i < endId; ++i) {
+			data->pos[i] = center;
+		}
+		return;
+	}
+
+	// center acts as an offset to the source positions
+	int src = m_cursor % sourceCount;
+	for (int i = startId; i < endId; ++i) {
+		data->pos[i] = source->pos[src] + center;
+		if (++src == sourceCount) src = 0;
+	}
+
+	if (inheritVelocity != 0.0f) {
+		src = m_cursor % sourceCount;
+		for (int i = startId; i < endId; ++i) {
+			data->vel[i] = inheritVelocity * source->vel[src];
+			if (++src == sourceCount) src = 0;
+		}
+	}
+
+	m_cursor = (m_cursor + endId - startId) % sourceCount;
+}
+
+int EventSpawner::getEmitCount(float dt) {
+	if (source == nullptr) return 0;
+
+	// Only consume each batch of events once, even if this system runs several steps per update
+	if (m_consumed && m_eventFrame == source->eventFrame) return 0;
+	m_eventFrame = source->eventFrame;
+	m_consumed = true;
+
+	m_events.clear();
+	for (int e = 0; e < source->eventCount; ++e) {
+		if (source->events[e].type & eventTypes) {
+			m_events.push_back(e);
+		}
+	}
+
+	return static_cast<int>(m_events.size()) * std::max(particlesPerEvent, 1);
+}
+
+void EventSpawner::spawn(ParticleData *data, int startId, int endId) {
+	if (m_events.empty()) {
+		for (int i = startId; i < endId; ++i) {
+			data->pos[i] = center;
+		}
+		return;
+	}
+
+	const int perEvent = std::max(particlesPerEvent, 1);
+	const int numEvents = static_cast<int>(m_events.size());
+	for (int i = startId; i < endId; ++i) {
+		const ParticleEvent &e = source->events[m_events[std::min((i - startId) / perEvent, numEvents - 1)]];
+		data->pos[i] = e.pos + center;
+		if (inheritVelocity != 0.0f) {
+			data->vel[i] = inheritVelocity * e.vel;
+		}
+	}
+}
+
 }
\ No newline at end of file
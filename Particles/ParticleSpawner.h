@@ -2,9 +2,10 @@
 
 #include <SFML/Graphics.hpp>
 
-namespace particles {
+#include "Particles/ParticleAlgorithms.h"
+#include "Particles/ParticleData.h"
 
-class ParticleData;
+namespace particles {
 
 /* Abstract base class for all generators */
 class ParticleSpawner {
@@ -13,9 +14,13 @@ public:
 	virtual ~ParticleSpawner() {}
 
 	virtual void spawn(ParticleData *data, int startId, int endId) = 0;
+	virtual float getMeasure() const { return 0.0f; }	// Area or length of the spawn region, for distributing particles across spawners
+	virtual int getEmitCount(float dt) { return 0; }	// Particles this spawner emits by itself each step, in addition to the system's emission
+	virtual bool emitsBySelf() const { return false; }	// Only places the particles of getEmitCount, left out of the system's emission
 
 public:
 	sf::Vector2f center{ 0.0f, 0.0f };
+	float weight{ 1.0f };	// Relative share of new particles when the particle system uses weighted spawner distribution
 };
 
 
@@ -33,6 +38,7 @@ public:
 	~BoxSpawner() {}
 
 	void spawn(ParticleData *data, int startId, int endId);
+	float getMeasure() const;
 
 public:
 	sf::Vector2f size{ 0.0f, 0.0f };
@@ -44,6 +50,7 @@ public:
 	~CircleSpawner() {}
 
 	void spawn(ParticleData *data, int startId, int endId);
+	float getMeasure() const;
 
 public:
 	sf::Vector2f radius{ 0.0f, 0.0f };
@@ -55,9 +62,164 @@ public:
 	~DiskSpawner() {}
 
 	void spawn(ParticleData *data, int startId, int endId);
+	float getMeasure() const;
 
 public:
 	sf::Vector2f radius{ 0.0f, 0.0f };
 };
 
+/* Spawns inside a box from a precomputed, tileable blue noise point set.
+   The tile is repeated over the box in world units and the tiling is wrapped around it with a random offset,
+   which changes every time every copy of the tile was used. */
+class PoissonDiskSpawner : public ParticleSpawner {
+public:
+	PoissonDiskSpawner() {}
+	~PoissonDiskSpawner() {}
+
+	void spawn(ParticleData *data, int startId, int endId);
+	float getMeasure() const;
+
+	void generateTile(int numPoints);	// Called with tilePoints on first use, call at load time to avoid the cost during gameplay
+
+public:
+	sf::Vector2f size{ 0.0f, 0.0f };
+	float tileSize{ 64.0f };	// Edge length of one square tile in world units, keeps the spacing isotropic for any box
+	int tilePoints{ 1024 };
+
+protected:
+	std::vector<sf::Vector2f> m_tile;	// Points in [0, 1)^2, ordered so that every prefix is well spread
+	sf::Vector2f m_offset{ 0.0f, 0.0f };
+	int m_cursor{ 0 };	// Runs over every tile point in every copy, point-major so that prefixes stay spread
+};
+
+/* Spawns on the opaque pixels of an image, weighted by alpha */
+class ImageSpawner : public ParticleSpawner {
+public:
+	ImageSpawner() {}
+	~ImageSpawner() {}
+
+	void spawn(ParticleData *data, int startId, int endId);
+	float getMeasure() const;
+
+	void setImage(const sf::Image &image);	// Builds the sampling table once, the image is not referenced afterwards
+
+public:
+	float scale{ 1.0f };			// World size of one pixel
+	bool jitter{ true };			// Random position inside the pixel instead of its center
+	sf::Uint8 alphaThreshold{ 0 };	// Pixels with alpha at or below are ignored, applied by setImage
+
+protected:
+	AliasTable m_table;
+	std::vector<sf::Vector2f> m_pixels;	// Pixel corners relative to the image center
+};
+
+/* Spawns uniformly inside a set of triangles, picking triangles by area */
+class PolygonSpawner : public ParticleSpawner {
+public:
+	PolygonSpawner() {}
+	~PolygonSpawner() {}
+
+	void spawn(ParticleData *data, int startId, int endId);
+	float getMeasure() const;
+
+	void setPolygon(const std::vector<sf::Vector2f> &points);	// Simple polygon relative to center, triangulated by ear clipping
+	void addTriangle(const sf::Vector2f &a, const sf::Vector2f &b, const sf::Vector2f &c);
+	void clear();
+
+	inline size_t numTriangles() const { return m_triangles.size() / 3; }
+
+protected:
+	void buildTable() const;	// Also caches the total area as the table's total weight
+
+protected:
+	std::vector<sf::Vector2f> m_triangles;	// Three corners per triangle
+	mutable AliasTable m_table;
+	mutable bool m_dirty{ false };
+};
+
+/* Spawns uniformly along connected line segments, picking segments by length */
+class PolylineSpawner : public ParticleSpawner {
+public:
+	PolylineSpawner() {}
+	~PolylineSpawner() {}
+
+	void spawn(ParticleData *data, int startId, int endId);
+	float getMeasure() const;
+
+	void setPoints(const std::vector<sf::Vector2f> &points);	// Relative to center
+	inline const std::vector<sf::Vector2f> &getPoints() const { return m_points; }
+
+public:
+	bool closed{ false };	// Connect the last point back to the first one
+
+protected:
+	inline bool isDirty() const { return m_dirty || m_closed != (closed && m_points.size() > 2); }
+	void buildTable() const;	// Also caches the total length as the table's total weight
+
+protected:
+	std::vector<sf::Vector2f> m_points;
+	mutable AliasTable m_table;
+	mutable bool m_dirty{ false };
+	mutable bool m_closed{ false };
+};
+
+/* Spawns uniformly along a Catmull-Rom spline through the control points.
+   The curve is tabulated once into short segments, which makes sampling proportional to arc length. */
+class SplineSpawner : public PolylineSpawner {
+public:
+	SplineSpawner() {}
+	~SplineSpawner() {}
+
+	void setControlPoints(const std::vector<sf::Vector2f> &points);	// Relative to center, uses closed and samplesPerSegment
+
+public:
+	int samplesPerSegment{ 16 };
+};
+
+/* Spawns at the live particles of another particle system, e.g. for trails and chained effects.
+   The source streams are read in place, so the source system has to outlive this spawner.
+   Sources in analytic mode only store their spawn state, so new particles appear at the source's origin. */
+class ParticleSystemSpawner : public ParticleSpawner {
+public:
+	ParticleSystemSpawner() {}
+	~ParticleSystemSpawner() {}
+
+	void spawn(ParticleData *data, int startId, int endId);
+	int getEmitCount(float dt);
+
+public:
+	const ParticleData *source{ nullptr };	// See ParticleSystem::getParticleData()
+	float emitRate{ 0.0f };					// Particles per second for each live source particle
+	float inheritVelocity{ 0.0f };			// Fraction of the source velocity passed on, velocity generators overwrite it
+
+protected:
+	float m_dt{ 0.0f };
+	int m_cursor{ 0 };	// Next source particle, sources are visited round robin in index order
+};
+
+/* Sub-emitter that spawns at the events another particle system recorded during its last update,
+   e.g. sparks on impact or smoke puffs on death. Update the source system before the one owning this spawner.
+   With fixedTimeStep the events are also consumed by updates that run no step, the new particles then start
+   moving with the next step. */
+class EventSpawner : public ParticleSpawner {
+public:
+	EventSpawner() {}
+	~EventSpawner() {}
+
+	void spawn(ParticleData *data, int startId, int endId);
+	int getEmitCount(float dt);
+	bool emitsBySelf() const { return true; }
+
+public:
+	const ParticleData *source{ nullptr };	// See ParticleSystem::getParticleData()
+	int eventTypes{ ParticleEvent::Death | ParticleEvent::Collision };	// Mask of ParticleEvent::Type
+	int particlesPerEvent{ 1 };
+	float inheritVelocity{ 0.0f };			// Fraction of the event velocity passed on, velocity generators overwrite it
+
+protected:
+	std::vector<int> m_events;	// Matching events of the source's last update
+	unsigned int m_eventFrame{ 0 };
+	bool m_consumed{ false };
+};
+
 }
\ No newline at end of file
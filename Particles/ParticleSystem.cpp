@@ -2,12 +2,22 @@
 
 #include "Particles/ParticleData.h"
 #include "Particles/ParticleHelpers.h"
+#include "Particles/ParticleThreads.h"
+
+#include <SFML/OpenGL.hpp>
+#include <SFML/Window/Context.hpp>
+
+#include <cstddef>
+
+#ifndef APIENTRY
+#define APIENTRY
+#endif
 
 namespace particles {
 
 /* ParticleSystem */
 
-ParticleSystem::ParticleSystem(int maxCount) : emitRate(0.f), m_dt(0.f) {
+ParticleSystem::ParticleSystem(int maxCount) : emitRate(0.f), spawnerDistribution(EvenDistribution), fixedTimeStep(false), timeStep(1.f / 60.f), maxSubSteps(4), sortMode(NoSort), maxThreads(std::max(static_cast<int>(std::thread::hardware_concurrency()), 1)), culling(false), cullAlphaThreshold(0), analytic(false), analyticAcceleration(0.f, 0.f), m_dt(0.f), m_time(0.f), m_timeAccumulator(0.f), m_interpolation(1.f), m_stepDt(1.f / 60.f), m_fixedStepActive(false), m_verticesDirty(true), m_verticesCulled(false), m_drawIndices(nullptr), m_drawCount(0) {
 	m_particles = new ParticleData(maxCount);
 }
 
@@ -52,13 +62,19 @@ void ParticleSystem::removeUpdater(ParticleUpdater *u) {
 }
 
 void ParticleSystem::emitWithRate(float dt) {
-	m_dt += dt;
-
 	int maxNewParticles = 0;
 
-	if (m_dt * emitRate > 1.0f) {
-		maxNewParticles = static_cast<int>(m_dt * emitRate);
-		m_dt -= maxNewParticles / emitRate;
+	if (emitRate > 0.0f) {
+		m_dt += dt;
+
+		if (m_dt * emitRate > 1.0f) {
+			maxNewParticles = static_cast<int>(m_dt * emitRate);
+			m_dt -= maxNewParticles / emitRate;
+		}
+	}
+
+	if (!emissionSchedule.empty()) {
+		maxNewParticles += emissionSchedule.advance(dt);
 	}
 
 	if (maxNewParticles == 0) return;
@@ -67,45 +83,424 @@ void ParticleSystem::emitWithRate(float dt) {
 }
 
 void ParticleSystem::emitParticles(int count) {
-	if (m_spawners.size() == 0) return;
+	// Spawners that emit by themselves, e.g. at events, have no positions for the system's own emission
+	const int nSpawners = static_cast<int>(m_spawners.size());
+	int nShared = 0;
+	for (auto spawner : m_spawners) {
+		if (!spawner->emitsBySelf()) nShared++;
+	}
+	if (nShared == 0) return;
+
+	m_verticesDirty = true;
 
 	const int startId = m_particles->countAlive;
 	const int endId = std::min(startId + count, m_particles->count - 1);
 	const int newParticles = endId - startId;
 
-	const int nSpawners = static_cast<int>(m_spawners.size());
-	const int spawnerCount = newParticles / nSpawners;
-	const int remainder = newParticles - spawnerCount * nSpawners;
+	m_spawnerCounts.assign(nSpawners, 0);
+
+	if (spawnerDistribution != EvenDistribution && nSpawners > 1) {
+		// Weights and measures rarely change, only rebuild the table if they did
+		bool changed = static_cast<int>(m_spawnerWeights.size()) != nSpawners;
+		m_spawnerWeights.resize(nSpawners);
+		for (int i = 0; i < nSpawners; ++i) {
+			float w = m_spawners[i]->emitsBySelf() ? 0.0f : m_spawners[i]->weight;
+			if (spawnerDistribution == MeasureDistribution && w != 0.0f) w *= m_spawners[i]->getMeasure();
+			changed = changed || m_spawnerWeights[i] != w;
+			m_spawnerWeights[i] = w;
+		}
+		if (changed) {
+			m_spawnerTable.build(m_spawnerWeights);
+		}
+	}
+
+	if (spawnerDistribution != EvenDistribution && nSpawners > 1 && !m_spawnerTable.empty()) {
+		// Pick a spawner per particle, but only count them so every spawner still fills one contiguous range
+		for (int i = 0; i < newParticles; ++i) {
+			m_spawnerCounts[m_spawnerTable.sample()]++;
+		}
+	}
+	else {
+		const int spawnerCount = newParticles / nShared;
+		const int remainder = newParticles - spawnerCount * nShared;
+		int shared = 0;
+		for (int i = 0; i < nSpawners; ++i) {
+			if (m_spawners[i]->emitsBySelf()) continue;
+			m_spawnerCounts[i] = (shared < remainder) ? spawnerCount + 1 : spawnerCount;
+			shared++;
+		}
+	}
+
 	int spawnerStartId = startId;
 	for (int i = 0; i < nSpawners; ++i) {
-		int numberToSpawn = (i < remainder) ? spawnerCount + 1 : spawnerCount;
-		m_spawners[i]->spawn(m_particles, spawnerStartId, spawnerStartId + numberToSpawn);
+		int numberToSpawn = m_spawnerCounts[i];
+		if (numberToSpawn > 0) {
+			m_spawners[i]->spawn(m_particles, spawnerStartId, spawnerStartId + numberToSpawn);
+		}
 		spawnerStartId += numberToSpawn;
 	}
 
+	generateParticles(startId, endId);
+}
+
+void ParticleSystem::emitFromSpawner(ParticleSpawner *spawner, int count) {
+	const int startId = m_particles->countAlive;
+	const int endId = std::min(startId + count, m_particles->count - 1);
+	if (endId <= startId) return;
+
+	spawner->spawn(m_particles, startId, endId);
+	generateParticles(startId, endId);
+}
+
+void ParticleSystem::emitFromSpawners(float dt) {
+	for (auto spawner : m_spawners) {
+		int count = spawner->getEmitCount(dt);
+		if (count > 0) {
+			emitFromSpawner(spawner, count);
+		}
+	}
+}
+
+void ParticleSystem::generateParticles(int startId, int endId) {
 	for (auto &generator : m_generators) {
 		generator->generate(m_particles, startId, endId);
 	}
 
-	m_particles->countAlive += newParticles;
+	for (int i = startId; i < endId; ++i) {
+		m_particles->prevPos[i] = m_particles->pos[i];
+		m_particles->prevAcc[i].x = FLT_MAX;
+		m_particles->spawnTime[i] = m_time;
+		m_particles->texCoordsDirty[i] = true;
+	}
+
+	// Keep the bounds conservative until the next integration pass
+	for (int i = startId; i < endId; ++i) {
+		const sf::Vector2f &pos = m_particles->pos[i];
+		float radius = ParticleData::boundsExtent * std::max(m_particles->size[i].x, m_particles->size[i].y);
+		m_particles->expandBounds(pos, radius);
+		m_particles->expandBounds(pos + m_stepDt * m_particles->vel[i], radius);
+	}
+
+	if (m_particles->history) {
+		const int length = m_particles->historyLength;
+		for (int i = startId; i < endId; ++i) {
+			std::fill(m_particles->history + i * length, m_particles->history + (i + 1) * length, m_particles->pos[i]);
+		}
+	}
+
+	m_particles->countAlive += endId - startId;
 }
 
 void ParticleSystem::update(const sf::Time &dt) {
-	if (emitRate > 0.0f) {
-		emitWithRate(dt.asSeconds());
+	m_particles->clearEvents();
+	m_verticesDirty = true;
+
+	if (!fixedTimeStep || timeStep <= 0.0f) {
+		step(dt.asSeconds());
+		m_interpolation = 1.0f;
+		m_fixedStepActive = false;
+		return;
 	}
 
-	for (int i = 0; i < m_particles->countAlive; ++i) {
-		m_particles->acc[i] = { 0.0f, 0.0f };
+	if (!m_fixedStepActive) {
+		// prevPos is only kept up to date by fixed steps, without this the first frames would interpolate from stale positions
+		std::copy(m_particles->pos, m_particles->pos + m_particles->countAlive, m_particles->prevPos);
+		m_timeAccumulator = 0.0f;
+		m_fixedStepActive = true;
 	}
 
+	m_timeAccumulator += dt.asSeconds();
+
+	int steps = 0;
+	while (m_timeAccumulator >= timeStep && steps < maxSubSteps) {
+		step(timeStep);
+		m_timeAccumulator -= timeStep;
+		steps++;
+	}
+
+	if (steps == 0) {
+		// Spawners fed by another system's events must see them before that system's next update clears them
+		emitFromSpawners(0.0f);
+	}
+
+	if (m_timeAccumulator >= timeStep) {
+		m_timeAccumulator = std::fmod(m_timeAccumulator, timeStep);
+	}
+
+	m_interpolation = m_timeAccumulator / timeStep;
+}
+
+void ParticleSystem::step(float dt) {
+	m_stepDt = dt;
+	emitWithRate(dt);
+	emitFromSpawners(dt);
+
+	m_time += dt;
+
+	if (analytic) {
+		// Only lifetime has to be tracked, everything else is evaluated when building vertices
+		killExpired(dt);
+		return;
+	}
+
+	if (fixedTimeStep) {
+		for (int i = 0; i < m_particles->countAlive; ++i) {
+			m_particles->prevPos[i] = m_particles->pos[i];
+			m_particles->acc[i] = { 0.0f, 0.0f };
+		}
+	}
+	else {
+		for (int i = 0; i < m_particles->countAlive; ++i) {
+			m_particles->acc[i] = { 0.0f, 0.0f };
+		}
+	}
+
+	m_particles->boundsValid = false;
+
 	for (auto & updater : m_updaters) {
-		updater->update(m_particles, dt.asSeconds());
+		updater->update(m_particles, dt);
+	}
+
+	if (!m_particles->boundsValid) {
+		computeBounds(dt);
+	}
+}
+
+void ParticleSystem::computeBounds(float dt) {
+	sf::Vector2f lo(FLT_MAX, FLT_MAX), hi(-FLT_MAX, -FLT_MAX);
+
+	for (int i = 0; i < m_particles->countAlive; ++i) {
+		const sf::Vector2f pos = m_particles->pos[i];
+
+		// One step in both directions covers interpolated rendering and the next collision test
+		const sf::Vector2f sweep = dt * m_particles->vel[i];
+		const float radius = ParticleData::boundsExtent * m_particles->size[i].x;
+
+		lo.x = std::min(lo.x, pos.x - std::abs(sweep.x) - radius);
+		lo.y = std::min(lo.y, pos.y - std::abs(sweep.y) - radius);
+		hi.x = std::max(hi.x, pos.x + std::abs(sweep.x) + radius);
+		hi.y = std::max(hi.y, pos.y + std::abs(sweep.y) + radius);
+	}
+
+	m_particles->boundsMin = lo;
+	m_particles->boundsMax = hi;
+	m_particles->boundsValid = true;
+}
+
+sf::FloatRect ParticleSystem::getBounds() const {
+	if (m_particles->countAlive <= 0) return sf::FloatRect();
+
+	const sf::Vector2f &lo = m_particles->boundsMin;
+	const sf::Vector2f &hi = m_particles->boundsMax;
+	return sf::FloatRect(lo.x, lo.y, hi.x - lo.x, hi.y - lo.y);
+}
+
+void ParticleSystem::killExpired(float dt) {
+	const sf::Vector2f halfAcc = 0.5f * analyticAcceleration;
+	sf::Vector2f lo(FLT_MAX, FLT_MAX), hi(-FLT_MAX, -FLT_MAX);
+
+	int i = 0;
+	while (i < m_particles->countAlive) {
+		// Streams hold the spawn state, evaluate where the particle actually is
+		const float t = m_time - m_particles->spawnTime[i];
+		const sf::Vector2f vel = m_particles->vel[i] + t * analyticAcceleration;
+		const sf::Vector2f pos = m_particles->pos[i] + t * m_particles->vel[i] + (t * t) * halfAcc;
+
+		if (t >= m_particles->time[i].y) {
+			if (m_particles->eventCount < m_particles->count) {
+				m_particles->events[m_particles->eventCount++] = { pos, vel, ParticleEvent::Death };
+			}
+			m_particles->kill(i);
+			continue;
+		}
+
+		// Bounds of the survivors in the same pass, one step in both directions covers rendering between steps
+		const sf::Vector2f sweep = dt * vel;
+		const float radius = ParticleData::boundsExtent * std::max(m_particles->size[i].y, m_particles->size[i].z);
+
+		lo.x = std::min(lo.x, pos.x - std::abs(sweep.x) - radius);
+		lo.y = std::min(lo.y, pos.y - std::abs(sweep.y) - radius);
+		hi.x = std::max(hi.x, pos.x + std::abs(sweep.x) + radius);
+		hi.y = std::max(hi.y, pos.y + std::abs(sweep.y) + radius);
+		++i;
 	}
+
+	m_particles->boundsMin = lo;
+	m_particles->boundsMax = hi;
+	m_particles->boundsValid = true;
+}
+
+void ParticleSystem::prewarm(float seconds, float maxStep) {
+	if (seconds <= 0.0f) return;
+
+	m_verticesDirty = true;
+
+	if (analytic && emissionSchedule.empty()) {
+		// Emit everything at once with back-dated spawn times. Only the youngest particles that fit the capacity are
+		// spawned, those already older than their lifetime are removed by killExpired below before they are ever drawn
+		m_time += seconds;
+
+		if (emitRate > 0.0f) {
+			m_dt += seconds;
+			const int total = static_cast<int>(m_dt * emitRate);
+			m_dt -= total / emitRate;
+
+			const int startId = m_particles->countAlive;
+			const int newParticles = std::min(total, std::max(m_particles->count - 1 - startId, 0));
+			emitParticles(newParticles);
+
+			// Youngest particle was emitted just now, older ones 1 / emitRate apart
+			const int endId = m_particles->countAlive;
+			for (int i = startId; i < endId; ++i) {
+				m_particles->spawnTime[i] = m_time - (endId - 1 - i) / emitRate;
+			}
+		}
+
+		killExpired(timeStep);
+		m_particles->clearEvents();
+		return;
+	}
+
+	const int steps = std::max(static_cast<int>(std::ceil(seconds / maxStep)), 1);
+	const float dt = seconds / steps;
+
+	for (int i = 0; i < steps; ++i) {
+		step(dt);
+	}
+
+	// Don't interpolate across the coarse prewarm steps
+	for (int i = 0; i < m_particles->countAlive; ++i) {
+		m_particles->prevPos[i] = m_particles->pos[i];
+	}
+
+	m_particles->clearEvents();
+}
+
+bool ParticleSystem::prepareDraw(const sf::RenderTarget &renderTarget, float extentScale) {
+	if (!culling) {
+		if (!m_verticesDirty && !m_verticesCulled) return false;
+
+		m_verticesDirty = false;
+		m_verticesCulled = false;
+		m_drawIndices = nullptr;
+		m_drawCount = m_particles->countAlive;
+		sortDrawIndices();
+		return true;
+	}
+
+	// Axis aligned extent of the (possibly rotated) view
+	const sf::View &view = renderTarget.getView();
+	const sf::Vector2f center = view.getCenter();
+	const sf::Vector2f half = 0.5f * view.getSize();
+	const float phi = view.getRotation() * DEG_TO_RAD;
+	const float c = std::abs(std::cos(phi));
+	const float s = std::abs(std::sin(phi));
+	const sf::Vector2f extent{ c * half.x + s * half.y, s * half.x + c * half.y };
+
+	// Vertices built for the same view since the last update can be reused
+	if (!m_verticesDirty && m_verticesCulled && center == m_cullCenter && extent == m_cullExtent) return false;
+
+	m_verticesDirty = false;
+	m_verticesCulled = true;
+	m_cullCenter = center;
+	m_cullExtent = extent;
+	m_drawIndices = nullptr;
+
+	// Whole system outside of the view
+	if (!m_particles->boundsOverlap(center - extent, center + extent)) {
+		m_drawCount = 0;
+		return false;
+	}
+
+	const float alpha = m_interpolation;
+	const sf::Vector2f *prevPos = (alpha < 1.0f) ? m_particles->prevPos : m_particles->pos;
+	const float renderTime = getRenderTime();
+	const sf::Vector2f halfAcc = 0.5f * analyticAcceleration;
+
+	m_visible.resize(m_particles->countAlive);
+	int *visible = m_visible.data();
+	int count = 0;
+
+	for (int i = 0; i < m_particles->countAlive; ++i) {
+		sf::Vector2f pos;
+		float size;
+		float opacity;
+
+		if (analytic) {
+			float t = std::max(renderTime - m_particles->spawnTime[i], 0.f);
+			float a = std::min(t / m_particles->time[i].y, 1.f);
+			pos = m_particles->pos[i] + t * m_particles->vel[i] + (t * t) * halfAcc;
+			size = lerpFloat(m_particles->size[i].y, m_particles->size[i].z, a);
+			opacity = lerpFloat(m_particles->startCol[i].a, m_particles->endCol[i].a, a);
+		}
+		else {
+			pos = prevPos[i] + alpha * (m_particles->pos[i] - prevPos[i]);
+			size = m_particles->size[i].x;
+			opacity = m_particles->col[i].a;
+		}
+
+		float radius = extentScale * size + 1.f;
+		bool inside = std::abs(pos.x - center.x) <= extent.x + radius && std::abs(pos.y - center.y) <= extent.y + radius;
+
+		visible[count] = i;
+		count += (inside && opacity > cullAlphaThreshold) ? 1 : 0;
+	}
+
+	m_drawIndices = visible;
+	m_drawCount = count;
+	sortDrawIndices();
+	return true;
+}
+
+void ParticleSystem::sortDrawIndices() {
+	if (sortMode == NoSort || m_drawCount < 2) return;
+	if (sortMode == SortByKey && !sortKey) return;
+
+	const int *indices = m_drawIndices;
+	m_sortKeys.resize(m_drawCount);
+	float *keys = m_sortKeys.data();
+
+	if (sortMode == OldestFirst || sortMode == YoungestFirst) {
+		const float sign = (sortMode == OldestFirst) ? 1.f : -1.f;
+		for (int n = 0; n < m_drawCount; ++n) {
+			const int i = indices ? indices[n] : n;
+			keys[n] = sign * m_particles->spawnTime[i];
+		}
+	}
+	else if (sortMode == SortByY && analytic) {
+		const float renderTime = getRenderTime();
+		for (int n = 0; n < m_drawCount; ++n) {
+			const int i = indices ? indices[n] : n;
+			float t = std::max(renderTime - m_particles->spawnTime[i], 0.f);
+			keys[n] = m_particles->pos[i].y + t * m_particles->vel[i].y + (0.5f * t * t) * analyticAcceleration.y;
+		}
+	}
+	else if (sortMode == SortByY) {
+		const float alpha = m_interpolation;
+		const sf::Vector2f *prevPos = (alpha < 1.0f) ? m_particles->prevPos : m_particles->pos;
+		for (int n = 0; n < m_drawCount; ++n) {
+			const int i = indices ? indices[n] : n;
+			keys[n] = prevPos[i].y + alpha * (m_particles->pos[i].y - prevPos[i].y);
+		}
+	}
+	else {
+		for (int n = 0; n < m_drawCount; ++n) {
+			const int i = indices ? indices[n] : n;
+			keys[n] = sortKey(m_particles, i);
+		}
+	}
+
+	m_sorter.sort(keys, indices, m_drawCount, maxThreads);
+	m_drawIndices = m_sorter.getIndices();
 }
 
 void ParticleSystem::reset() {
 	m_particles->countAlive = 0;
+	m_particles->resetBounds();
+	m_verticesDirty = true;
+	m_timeAccumulator = 0.f;
+	m_time = 0.f;
+	emissionSchedule.restart();
 }
 
 
@@ -116,29 +511,64 @@ PointParticleSystem::PointParticleSystem(int maxCount) : ParticleSystem(maxCount
 }
 
 void PointParticleSystem::render(sf::RenderTarget &renderTarget) {
-	updateVertices();
+	if (prepareDraw(renderTarget, 0.f)) {
+		updateVertices();
+	}
 
-	if (m_particles->countAlive <= 0) return;
+	if (m_drawCount <= 0) return;
 
 	sf::RenderStates states = sf::RenderStates::Default;
 
 	const sf::Vertex *ver = &m_vertices[0];
-	renderTarget.draw(ver, m_particles->countAlive, sf::Points, states);
+	renderTarget.draw(ver, m_drawCount, sf::Points, states);
 }
 
 void PointParticleSystem::updateVertices() {
-	for (int i = 0; i < m_particles->countAlive; ++i) {
-		m_vertices[i].position = m_particles->pos[i];
-		m_vertices[i].color = m_particles->col[i];
+	const int *indices = m_drawIndices;
+
+	if (analytic) {
+		const float renderTime = getRenderTime();
+		const sf::Vector2f halfAcc = 0.5f * analyticAcceleration;
+
+		for (int n = 0; n < m_drawCount; ++n) {
+			const int i = indices ? indices[n] : n;
+			float t = std::max(renderTime - m_particles->spawnTime[i], 0.f);
+			float a = std::min(t / m_particles->time[i].y, 1.f);
+
+			m_vertices[n].position = m_particles->pos[i] + t * m_particles->vel[i] + (t * t) * halfAcc;
+			m_vertices[n].color = lerpColor(m_particles->startCol[i], m_particles->endCol[i], a);
+		}
+		return;
+	}
+
+	const float alpha = m_interpolation;
+	const sf::Vector2f *prevPos = (alpha < 1.0f) ? m_particles->prevPos : m_particles->pos;
+
+	for (int n = 0; n < m_drawCount; ++n) {
+		const int i = indices ? indices[n] : n;
+		m_vertices[n].position = prevPos[i] + alpha * (m_particles->pos[i] - prevPos[i]);
+		m_vertices[n].color = m_particles->col[i];
 	}
 }
 
 
 /* TextureParticleSystem */
 
-TextureParticleSystem::TextureParticleSystem(int maxCount, sf::Texture *texture) : ParticleSystem(maxCount), m_texture(texture) {
+TextureParticleSystem::TextureParticleSystem(int maxCount, sf::Texture *texture) : ParticleSystem(maxCount), m_texture(texture), m_texCoordsCurrent(false), m_texCoordsCompact(false), m_verticesCompact(false), m_batchVertices(nullptr), m_batchCompactVertices(nullptr) {
 	m_vertices = sf::VertexArray(sf::Quads, maxCount * 4);
 
+	// Two triangles per particle quad, the same for every frame
+	m_indices.resize(maxCount * 6);
+	for (int i = 0; i < maxCount; ++i) {
+		const GLuint v = 4 * i;
+		m_indices[6 * i + 0] = v + 0;
+		m_indices[6 * i + 1] = v + 1;
+		m_indices[6 * i + 2] = v + 2;
+		m_indices[6 * i + 3] = v + 0;
+		m_indices[6 * i + 4] = v + 2;
+		m_indices[6 * i + 5] = v + 3;
+	}
+
 	float x = static_cast<float>(m_texture->getSize().x);
 	float y = static_cast<float>(m_texture->getSize().y);
 
@@ -155,10 +585,12 @@ TextureParticleSystem::TextureParticleSystem(int maxCount, sf::Texture *texture)
 	}
 
 	additiveBlendMode = false;
+	compactVertices = false;
 }
 
 void TextureParticleSystem::setTexture(sf::Texture *texture) {
 	m_texture = texture;
+	m_texCoordsCurrent = false;
 
 	float x = static_cast<float>(m_texture->getSize().x);
 	float y = static_cast<float>(m_texture->getSize().y);
@@ -172,89 +604,253 @@ void TextureParticleSystem::setTexture(sf::Texture *texture) {
 }
 
 void TextureParticleSystem::updateVertices() {
-	for (int i = 0; i < m_particles->countAlive; ++i) {
-		float size = 0.5f * m_particles->size[i].x;
-		float angle = m_particles->angle[i].x;
-		
-		m_vertices[4 * i + 0].position.x = -size;	m_vertices[4 * i + 0].position.y = -size;
-		m_vertices[4 * i + 1].position.x = +size;	m_vertices[4 * i + 1].position.y = -size;
-		m_vertices[4 * i + 2].position.x = +size;	m_vertices[4 * i + 2].position.y = +size;
-		m_vertices[4 * i + 3].position.x = -size;	m_vertices[4 * i + 3].position.y = +size;
-
-		if (angle != 0.f) {
-			float sin = std::sin(angle); float cos = std::cos(angle);
-
-			for (int j = 0; j < 4; ++j) {
-				float x = m_vertices[4 * i + j].position.x;
-				float y = m_vertices[4 * i + j].position.y;
-
-				m_vertices[4 * i + j].position.x = cos * x - sin * y;
-				m_vertices[4 * i + j].position.y = sin * x + cos * y;
+	// Threads only pay off for large systems
+	const int minParticlesPerThread = 8192;
+
+	m_verticesCompact = usesCompactLayout();
+
+	if (m_verticesCompact) {
+		if (m_batchCompactVertices) {
+			CompactVertex *vertices = m_batchCompactVertices;
+			parallelFor(m_drawCount, minParticlesPerThread, maxThreads, [this, vertices](int begin, int end) {
+				buildVertices(vertices, begin, end);
+			});
+			return;
+		}
+
+		if (m_compactVertices.empty()) {
+			m_compactVertices.resize(4 * m_particles->count);
+
+			for (int i = 0; i < m_particles->count; ++i) {
+				CompactVertex *quad = &m_compactVertices[4 * i];
+				quad[0].texCoords[0] = 0;		quad[0].texCoords[1] = 0;
+				quad[1].texCoords[0] = 65535;	quad[1].texCoords[1] = 0;
+				quad[2].texCoords[0] = 65535;	quad[2].texCoords[1] = 65535;
+				quad[3].texCoords[0] = 0;		quad[3].texCoords[1] = 65535;
+			}
+		}
+
+		CompactVertex *vertices = m_compactVertices.data();
+		parallelFor(m_drawCount, minParticlesPerThread, maxThreads, [this, vertices](int begin, int end) {
+			buildVertices(vertices, begin, end);
+		});
+		return;
+	}
+
+	sf::Vertex *vertices = m_batchVertices ? m_batchVertices : &m_vertices[0];
+	parallelFor(m_drawCount, minParticlesPerThread, maxThreads, [this, vertices](int begin, int end) {
+		buildVertices(vertices, begin, end);
+	});
+}
+
+template<typename Vertex>
+void TextureParticleSystem::buildVertices(Vertex *vertices, int begin, int end) {
+	const int *indices = m_drawIndices;
+	const float alpha = m_interpolation;
+	const sf::Vector2f *prevPos = (alpha < 1.0f) ? m_particles->prevPos : m_particles->pos;
+	const float renderTime = getRenderTime();
+	const sf::Vector2f halfAcc = 0.5f * analyticAcceleration;
+
+	// Particles are processed in blocks: gather, then trig over the block, then expand the quads
+	const int blockSize = 8;
+	float size[blockSize], angle[blockSize], sinA[blockSize], cosA[blockSize];
+	sf::Vector2f pos[blockSize];
+	sf::Color col[blockSize];
+
+	for (int blockStart = begin; blockStart < end; blockStart += blockSize) {
+		const int num = std::min(blockSize, end - blockStart);
+
+		for (int k = 0; k < num; ++k) {
+			const int n = blockStart + k;
+			const int i = indices ? indices[n] : n;
+
+			if (analytic) {
+				float t = std::max(renderTime - m_particles->spawnTime[i], 0.f);
+				float a = std::min(t / m_particles->time[i].y, 1.f);
+
+				size[k] = 0.5f * lerpFloat(m_particles->size[i].y, m_particles->size[i].z, a);
+				angle[k] = lerpFloat(m_particles->angle[i].y, m_particles->angle[i].z, a);
+				pos[k] = m_particles->pos[i] + t * m_particles->vel[i] + (t * t) * halfAcc;
+				col[k] = lerpColor(m_particles->startCol[i], m_particles->endCol[i], a);
+			}
+			else {
+				size[k] = 0.5f * m_particles->size[i].x;
+				angle[k] = m_particles->angle[i].x;
+				pos[k] = prevPos[i] + alpha * (m_particles->pos[i] - prevPos[i]);
+				col[k] = m_particles->col[i];
 			}
 		}
 
-		m_vertices[4 * i + 0].position.x += m_particles->pos[i].x;	m_vertices[4 * i + 0].position.y += m_particles->pos[i].y;
-		m_vertices[4 * i + 1].position.x += m_particles->pos[i].x;	m_vertices[4 * i + 1].position.y += m_particles->pos[i].y;
-		m_vertices[4 * i + 2].position.x += m_particles->pos[i].x;	m_vertices[4 * i + 2].position.y += m_particles->pos[i].y;
-		m_vertices[4 * i + 3].position.x += m_particles->pos[i].x;	m_vertices[4 * i + 3].position.y += m_particles->pos[i].y;
+		// Without -ffast-math the compiler keeps these as scalar libm calls, so unrotated particles skip them
+		for (int k = 0; k < num; ++k) {
+			if (angle[k] == 0.f) {
+				sinA[k] = 0.f;
+				cosA[k] = 1.f;
+			}
+			else {
+				sinA[k] = std::sin(angle[k]);
+				cosA[k] = std::cos(angle[k]);
+			}
+		}
+
+		for (int k = 0; k < num; ++k) {
+			Vertex *quad = &vertices[4 * (blockStart + k)];
+
+			// Corners (-size, -size), (size, -size), (size, size), (-size, size) rotated by angle
+			const float c = cosA[k] * size[k];
+			const float s = sinA[k] * size[k];
+			const sf::Vector2f p = pos[k];
 
-		m_vertices[4 * i + 0].color = m_particles->col[i];
-		m_vertices[4 * i + 1].color = m_particles->col[i];
-		m_vertices[4 * i + 2].color = m_particles->col[i];
-		m_vertices[4 * i + 3].color = m_particles->col[i];
+			quad[0].position.x = p.x - c + s;	quad[0].position.y = p.y - s - c;
+			quad[1].position.x = p.x + c + s;	quad[1].position.y = p.y + s - c;
+			quad[2].position.x = p.x + c - s;	quad[2].position.y = p.y + s + c;
+			quad[3].position.x = p.x - c - s;	quad[3].position.y = p.y - s + c;
+
+			quad[0].color = col[k];
+			quad[1].color = col[k];
+			quad[2].color = col[k];
+			quad[3].color = col[k];
+		}
+	}
+}
+
+void TextureParticleSystem::prepareVertices(const sf::RenderTarget &renderTarget) {
+	// Switching the vertex layout needs a rebuild even if the particles didn't change
+	if (prepareDraw(renderTarget, ParticleData::boundsExtent) || m_verticesCompact != usesCompactLayout()) {
+		updateVertices();
 	}
 }
 
 void TextureParticleSystem::render(sf::RenderTarget &renderTarget) {
-	updateVertices();
+	prepareVertices(renderTarget);
 
-	if (m_particles->countAlive <= 0) return;
+	if (m_drawCount <= 0) return;
 
-	sf::RenderStates states = sf::RenderStates::Default;
+	drawVertices(renderTarget, additiveBlendMode);
+}
 
-	if (additiveBlendMode) {
-		states.blendMode = sf::BlendAdd;
+void TextureParticleSystem::drawVertices(sf::RenderTarget &renderTarget, bool additive) {
+	// The last build went to a ParticleBatch, which draws it
+	if (isBatched()) return;
+
+	// sf::RenderTarget neither draws indexed primitives nor custom vertex layouts, so go through OpenGL with SFML's states saved
+	renderTarget.pushGLStates();
+
+	const sf::View &view = renderTarget.getView();
+	const sf::IntRect viewport = renderTarget.getViewport(view);
+	const int top = static_cast<int>(renderTarget.getSize().y) - (viewport.top + viewport.height);
+	glViewport(viewport.left, top, viewport.width, viewport.height);
+
+	glMatrixMode(GL_PROJECTION);
+	glLoadMatrixf(view.getTransform().getMatrix());
+	glMatrixMode(GL_MODELVIEW);
+	glLoadIdentity();
+
+	if (additive) {
+		setAdditiveBlending();
 	}
 
-	states.texture = m_texture;
+	if (m_verticesCompact) {
+		// Scale the 16 bit texture coordinates down to [0, 1] on top of the matrix SFML sets for the texture
+		sf::Texture::bind(m_texture, sf::Texture::Normalized);
+		glMatrixMode(GL_TEXTURE);
+		glScalef(1.f / 65535.f, 1.f / 65535.f, 1.f);
+		glMatrixMode(GL_MODELVIEW);
+
+		const char *data = reinterpret_cast<const char *>(m_compactVertices.data());
+		glVertexPointer(2, GL_FLOAT, sizeof(CompactVertex), data + offsetof(CompactVertex, position));
+		glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(CompactVertex), data + offsetof(CompactVertex, color));
+		glTexCoordPointer(2, GL_UNSIGNED_SHORT, sizeof(CompactVertex), data + offsetof(CompactVertex, texCoords));
+	}
+	else {
+		sf::Texture::bind(m_texture, sf::Texture::Pixels);
 
-	const sf::Vertex *ver = &m_vertices[0];
-	renderTarget.draw(ver, m_particles->countAlive * 4, sf::Quads, states);
+		const char *data = reinterpret_cast<const char *>(&m_vertices[0]);
+		glVertexPointer(2, GL_FLOAT, sizeof(sf::Vertex), data + offsetof(sf::Vertex, position));
+		glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(sf::Vertex), data + offsetof(sf::Vertex, color));
+		glTexCoordPointer(2, GL_FLOAT, sizeof(sf::Vertex), data + offsetof(sf::Vertex, texCoords));
+	}
+
+	glDrawElements(GL_TRIANGLES, m_drawCount * 6, GL_UNSIGNED_INT, m_indices.data());
+
+	renderTarget.popGLStates();
 }
 
+void TextureParticleSystem::setAdditiveBlending() {
+	// glBlendFuncSeparate is OpenGL 1.4 and not exported by every platform's GL header, so it is looked up once
+	typedef void (APIENTRY *BlendFuncSeparate)(GLenum, GLenum, GLenum, GLenum);
+	static const BlendFuncSeparate blendFuncSeparate = reinterpret_cast<BlendFuncSeparate>(sf::Context::getFunction("glBlendFuncSeparate"));
 
-/* SpriteSheetParticleSystem */
+	// Same factors as sf::BlendAdd: the metaball threshold reads the summed alpha
+	if (blendFuncSeparate) {
+		blendFuncSeparate(GL_SRC_ALPHA, GL_ONE, GL_ONE, GL_ONE);
+	}
+	else {
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+	}
+}
 
-void SpriteSheetParticleSystem::render(sf::RenderTarget &renderTarget) {
-	updateVertices();
-	
-	if (m_particles->countAlive <= 0) return;
 
-	sf::RenderStates states = sf::RenderStates::Default;
+/* SpriteSheetParticleSystem */
 
-	if (additiveBlendMode) {
-		states.blendMode = sf::BlendAdd;
-	}
+void SpriteSheetParticleSystem::render(sf::RenderTarget &renderTarget) {
+	prepareVertices(renderTarget);
 
-	states.texture = m_texture;
+	if (m_drawCount <= 0) return;
 
-	const sf::Vertex *ver = &m_vertices[0];
-	renderTarget.draw(ver, m_particles->countAlive * 4, sf::Quads, states);
+	drawVertices(renderTarget, additiveBlendMode);
 }
 
 void SpriteSheetParticleSystem::updateVertices() {
 	TextureParticleSystem::updateVertices();
 
-	for (int i = 0; i < m_particles->countAlive; ++i) {
-		float left = static_cast<float>(m_particles->texCoords[i].left);
-		float top = static_cast<float>(m_particles->texCoords[i].top);
+	const int *indices = m_drawIndices;
+	bool *dirty = m_particles->texCoordsDirty;
+	const bool compact = m_verticesCompact;
+
+	// Vertex slots map to particles one to one, only changed texture coordinates have to be written
+	const bool incremental = (indices == nullptr) && m_texCoordsCurrent && (m_texCoordsCompact == compact);
+	m_texCoordsCurrent = (indices == nullptr);
+	m_texCoordsCompact = compact;
+
+	// Inside a batch the coordinates are moved into the texture's place in the atlas
+	const sf::Vector2f offset = isBatched() ? m_texCoordOffset : sf::Vector2f(0.f, 0.f);
+	const sf::Vector2f space = isBatched() ? m_texCoordSpace : sf::Vector2f(m_texture->getSize());
+	const float scaleX = 65535.f / std::max(space.x, 1.f);
+	const float scaleY = 65535.f / std::max(space.y, 1.f);
+
+	sf::Vertex *vertices = m_batchVertices ? m_batchVertices : &m_vertices[0];
+	CompactVertex *compactVertices = m_batchCompactVertices ? m_batchCompactVertices : m_compactVertices.data();
+
+	for (int n = 0; n < m_drawCount; ++n) {
+		const int i = indices ? indices[n] : n;
+		if (incremental && !dirty[i]) continue;
+		dirty[i] = false;
+
+		float left = offset.x + static_cast<float>(m_particles->texCoords[i].left);
+		float top = offset.y + static_cast<float>(m_particles->texCoords[i].top);
 		float width = static_cast<float>(m_particles->texCoords[i].width);
 		float height = static_cast<float>(m_particles->texCoords[i].height);
 
-		m_vertices[4 * i + 0].texCoords = sf::Vector2f(left, top);
-		m_vertices[4 * i + 1].texCoords = sf::Vector2f(left + width, top);
-		m_vertices[4 * i + 2].texCoords = sf::Vector2f(left + width, top + height);
-		m_vertices[4 * i + 3].texCoords = sf::Vector2f(left, top + height);
+		if (compact) {
+			sf::Uint16 u0 = static_cast<sf::Uint16>(std::min(left * scaleX + 0.5f, 65535.f));
+			sf::Uint16 v0 = static_cast<sf::Uint16>(std::min(top * scaleY + 0.5f, 65535.f));
+			sf::Uint16 u1 = static_cast<sf::Uint16>(std::min((left + width) * scaleX + 0.5f, 65535.f));
+			sf::Uint16 v1 = static_cast<sf::Uint16>(std::min((top + height) * scaleY + 0.5f, 65535.f));
+
+			CompactVertex *quad = &compactVertices[4 * n];
+			quad[0].texCoords[0] = u0;	quad[0].texCoords[1] = v0;
+			quad[1].texCoords[0] = u1;	quad[1].texCoords[1] = v0;
+			quad[2].texCoords[0] = u1;	quad[2].texCoords[1] = v1;
+			quad[3].texCoords[0] = u0;	quad[3].texCoords[1] = v1;
+			continue;
+		}
+
+		sf::Vertex *quad = &vertices[4 * n];
+		quad[0].texCoords = sf::Vector2f(left, top);
+		quad[1].texCoords = sf::Vector2f(left + width, top);
+		quad[2].texCoords = sf::Vector2f(left + width, top + height);
+		quad[3].texCoords = sf::Vector2f(left, top + height);
 	}
 }
 
@@ -285,40 +881,205 @@ const std::string fragmentShader = \
 	"    }" \
 	"}";
 
-MetaballParticleSystem::MetaballParticleSystem(int maxCount, sf::Texture *texture, int windowWidth, int windowHeight) : TextureParticleSystem(maxCount, texture) {
-	additiveBlendMode = true;
-	m_shader.setUniform("texture", sf::Shader::CurrentTexture);
+MetaballLayer::MetaballLayer() {
 	m_shader.loadFromMemory(vertexShader, fragmentShader);
-	m_renderTexture.create(windowWidth, windowHeight);
+	m_shader.setUniform("texture", sf::Shader::CurrentTexture);
 }
 
-void MetaballParticleSystem::render(sf::RenderTarget &renderTarget) {
-	updateVertices();
+void MetaballLayer::addSystem(MetaballParticleSystem *system) {
+	if (system == nullptr) return;
+	if (std::find(m_systems.begin(), m_systems.end(), system) != m_systems.end()) return;
+	m_systems.push_back(system);
+}
 
-	if (m_particles->countAlive <= 0) return;
+void MetaballLayer::removeSystem(MetaballParticleSystem *system) {
+	auto it = std::find(m_systems.begin(), m_systems.end(), system);
+	if (it == m_systems.end()) return;
+	m_systems.erase(it);
+}
 
-	sf::RenderStates states = sf::RenderStates::Default;
-	states.blendMode = sf::BlendAdd;
+void MetaballLayer::resize(const sf::Vector2u &targetSize) {
+	const float scale = std::min(std::max(resolutionScale, 0.01f), 1.f);
+	const sf::Vector2u size(
+		std::max(static_cast<unsigned int>(targetSize.x * scale + 0.5f), 1u),
+		std::max(static_cast<unsigned int>(targetSize.y * scale + 0.5f), 1u));
 
-	states.texture = m_texture;
+	// Only reallocate when the window or the scale actually changed
+	if (m_renderTexture.getSize() == size) return;
 
-	const sf::Vertex *ver = &m_vertices[0];
+	m_renderTexture.create(size.x, size.y);
+	m_renderTexture.setSmooth(true);
+}
 
-	sf::View oldView = renderTarget.getView();
-	sf::View defaultView = renderTarget.getDefaultView();
+void MetaballLayer::render(sf::RenderTarget &renderTarget) {
+	const sf::Vector2u targetSize = renderTarget.getSize();
+	resize(targetSize);
 
-	m_renderTexture.setView(oldView);
+	const sf::View view = renderTarget.getView();
+	m_renderTexture.setView(view);
 	m_renderTexture.clear(sf::Color(0, 0, 0, 0));
-	m_renderTexture.draw(ver, m_particles->countAlive * 4, sf::Quads, states);
+
+	int drawn = 0;
+	for (auto system : m_systems) {
+		system->prepareVertices(renderTarget);
+		if (system->m_drawCount <= 0) continue;
+
+		system->drawVertices(m_renderTexture, true);
+		drawn += system->m_drawCount;
+	}
+
+	if (drawn == 0) return;
+
 	m_renderTexture.display();
-	m_sprite.setTexture(m_renderTexture.getTexture());
+
+	// Stretch the offscreen target over the whole render target
+	const sf::Vector2u size = m_renderTexture.getSize();
+	m_sprite.setTexture(m_renderTexture.getTexture(), true);
+	m_sprite.setScale(static_cast<float>(targetSize.x) / size.x, static_cast<float>(targetSize.y) / size.y);
+
 	sf::Glsl::Vec4 colorVec = sf::Glsl::Vec4(color.r / 255.f, color.g / 255.f, color.b / 255.f, color.a / 255.f);
 	m_shader.setUniform("customColor", colorVec);
 	m_shader.setUniform("threshold", threshold);
-	
-	renderTarget.setView(defaultView);
+
+	renderTarget.setView(sf::View(sf::FloatRect(0.f, 0.f, static_cast<float>(targetSize.x), static_cast<float>(targetSize.y))));
 	renderTarget.draw(m_sprite, &m_shader);
-	renderTarget.setView(oldView);
+	renderTarget.setView(view);
+}
+
+
+MetaballParticleSystem::MetaballParticleSystem(int maxCount, sf::Texture *texture, int windowWidth, int windowHeight) : TextureParticleSystem(maxCount, texture) {
+	additiveBlendMode = true;
+}
+
+MetaballParticleSystem::~MetaballParticleSystem() {
+	delete m_layer;
+}
+
+void MetaballParticleSystem::render(sf::RenderTarget &renderTarget) {
+	if (m_layer == nullptr) {
+		m_layer = new MetaballLayer();
+		m_layer->addSystem(this);
+	}
+
+	m_layer->color = color;
+	m_layer->threshold = threshold;
+	m_layer->resolutionScale = resolutionScale;
+	m_layer->render(renderTarget);
+}
+
+
+
+/* RibbonParticleSystem */
+
+RibbonParticleSystem::RibbonParticleSystem(int maxCount, int historyLength, sf::Texture *texture) : ParticleSystem(maxCount), additiveBlendMode(false), m_texture(texture) {
+	m_particles->enableHistory(std::max(historyLength, 2));
+	m_vertices = sf::VertexArray(sf::TriangleStrip, maxCount * getVerticesPerParticle());
+}
+
+void RibbonParticleSystem::update(const sf::Time &dt) {
+	ParticleSystem::update(dt);
+	captureHistory();
+}
+
+void RibbonParticleSystem::captureHistory() {
+	const int length = m_particles->historyLength;
+	const int head = (m_particles->historyHead + 1) % length;
+	m_particles->historyHead = head;
+
+	sf::Vector2f *history = m_particles->history;
+
+	if (analytic) {
+		const float renderTime = getRenderTime();
+		const sf::Vector2f halfAcc = 0.5f * analyticAcceleration;
+		for (int i = 0; i < m_particles->countAlive; ++i) {
+			float t = std::max(renderTime - m_particles->spawnTime[i], 0.f);
+			history[i * length + head] = m_particles->pos[i] + t * m_particles->vel[i] + (t * t) * halfAcc;
+		}
+	}
+	else {
+		// Capture the rendered position, so fixed steps are interpolated along the whole ribbon
+		const float alpha = m_interpolation;
+		const sf::Vector2f *prevPos = (alpha < 1.0f) ? m_particles->prevPos : m_particles->pos;
+		for (int i = 0; i < m_particles->countAlive; ++i) {
+			history[i * length + head] = prevPos[i] + alpha * (m_particles->pos[i] - prevPos[i]);
+		}
+	}
+}
+
+void RibbonParticleSystem::updateVertices() {
+	const int length = m_particles->historyLength;
+	const int head = m_particles->historyHead;
+	const int perParticle = getVerticesPerParticle();
+	const float invLast = 1.f / (length - 1);
+	const float texWidth = m_texture ? static_cast<float>(m_texture->getSize().x) : 0.f;
+	const float texHeight = m_texture ? static_cast<float>(m_texture->getSize().y) : 0.f;
+
+	m_points.resize(length);
+	sf::Vector2f *points = m_points.data();
+
+	for (int n = 0; n < m_drawCount; ++n) {
+		const int i = m_drawIndices ? m_drawIndices[n] : n;
+
+		// Unroll the ring buffer newest point first, as the two contiguous runs before and after the head
+		const sf::Vector2f *history = m_particles->history + i * length;
+		int k = 0;
+		for (int j = head; j >= 0; --j) {
+			points[k++] = history[j];
+		}
+		for (int j = length - 1; j > head; --j) {
+			points[k++] = history[j];
+		}
+
+		float halfWidth = 0.5f * m_particles->size[i].x;
+		sf::Color col = m_particles->col[i];
+		sf::Vertex *v = &m_vertices[n * perParticle] + 1;
+
+		for (int k = 0; k < length; ++k) {
+			sf::Vector2f tangent = points[std::max(k - 1, 0)] - points[std::min(k + 1, length - 1)];
+			float len = std::sqrt(tangent.x * tangent.x + tangent.y * tangent.y);
+			float fade = 1.f - k * invLast;
+			float scale = (len > 0.f) ? halfWidth * fade / len : 0.f;
+			sf::Vector2f offset{ -tangent.y * scale, tangent.x * scale };
+
+			sf::Color c = col;
+			c.a = static_cast<sf::Uint8>(col.a * fade);
+
+			v[2 * k + 0].position = points[k] + offset;
+			v[2 * k + 1].position = points[k] - offset;
+			v[2 * k + 0].color = c;
+			v[2 * k + 1].color = c;
+			v[2 * k + 0].texCoords = sf::Vector2f(k * invLast * texWidth, 0.f);
+			v[2 * k + 1].texCoords = sf::Vector2f(k * invLast * texWidth, texHeight);
+		}
+
+		// Repeat the first and last vertex so consecutive ribbons are joined by degenerate triangles
+		v[-1] = v[0];
+		v[2 * length] = v[2 * length - 1];
+	}
+}
+
+void RibbonParticleSystem::render(sf::RenderTarget &renderTarget) {
+	// Ribbons reach back over their history, which the per particle cull of prepareDraw doesn't see, so only sort
+	if (m_verticesDirty) {
+		m_verticesDirty = false;
+		m_drawIndices = nullptr;
+		m_drawCount = m_particles->countAlive;
+		sortDrawIndices();
+		updateVertices();
+	}
+
+	if (m_drawCount <= 0) return;
+
+	sf::RenderStates states = sf::RenderStates::Default;
+
+	if (additiveBlendMode) {
+		states.blendMode = sf::BlendAdd;
+	}
+
+	states.texture = m_texture;
+
+	const sf::Vertex *ver = &m_vertices[0];
+	renderTarget.draw(ver, m_drawCount * getVerticesPerParticle(), sf::TriangleStrip, states);
 }
 
 }
\ No newline at end of file
@@ -2,10 +2,14 @@
 
 #include <SFML/Graphics.hpp>
 
+#include "Particles/ParticleAlgorithms.h"
+#include "Particles/ParticleEmission.h"
 #include "Particles/ParticleGenerator.h"
 #include "Particles/ParticleSpawner.h"
 #include "Particles/ParticleUpdater.h"
 
+#include <functional>
+
 namespace particles {
 
 class ParticleData;
@@ -13,6 +17,20 @@ class ParticleData;
 /* Abstract base class for all particle system types */
 class ParticleSystem : public sf::Transformable {
 public:
+	enum SortMode {
+		NoSort,			// Storage order, which changes whenever particles die
+		OldestFirst,	// Young particles are drawn on top
+		YoungestFirst,
+		SortByY,		// Back to front for top down views, lower particles are drawn on top
+		SortByKey		// Ascending sortKey, e.g. a depth value
+	};
+
+	enum SpawnerDistribution {
+		EvenDistribution,		// Same number of particles for every spawner
+		WeightDistribution,		// Proportional to ParticleSpawner::weight
+		MeasureDistribution		// Proportional to spawner area or length times weight, for uniform density
+	};
+
 	ParticleSystem(int maxCount);
 	virtual ~ParticleSystem();
 
@@ -22,6 +40,7 @@ public:
 	void reset();
 
 	virtual void update(const sf::Time &dt);
+	void prewarm(float seconds, float maxStep = 0.1f);	// fast forward, e.g. to start ambient effects in their steady state
 	virtual void render(sf::RenderTarget &renderTarget) = 0;
 
 	template<typename T>
@@ -51,6 +70,10 @@ public:
 
 	void emitParticles(int count); 	// emit a fix number of particles
 
+	inline const ParticleData *getParticleData() const { return m_particles; }	// e.g. as source of a ParticleSystemSpawner
+	inline void invalidateVertices() { m_verticesDirty = true; }	// force a vertex rebuild after changing render settings between updates
+	sf::FloatRect getBounds() const;	// conservative bounding box of all alive particles, e.g. to skip update or render of whole systems
+
 	inline size_t getNumberGenerators() const { return m_generators.size(); }
 	inline size_t getNumberSpawners() const { return m_spawners.size(); }
 	inline size_t getNumberUpdaters() const { return m_updaters.size(); }
@@ -77,13 +100,43 @@ public:
 	}
 
 protected:
-	void emitWithRate(float dt);	// emit a stream of particles defined by emitRate and dt
+	void step(float dt);			// advance the simulation by dt: emission, then all updaters
+	void killExpired(float dt);		// lifetime handling of analytic mode, rebuilds the bounds of the survivors on the way
+	void computeBounds(float dt);	// fallback if no integration pass rebuilt the bounds during a step
+	bool prepareDraw(const sf::RenderTarget &renderTarget, float extentScale);	// select the particles to build vertices for, false if the last build can be reused
+	void sortDrawIndices();			// reorder the selected particles by sortMode
+	inline float getRenderTime() const { return m_time - (1.f - m_interpolation) * timeStep; }
+	void emitWithRate(float dt);	// emit a stream of particles defined by emitRate, emissionSchedule and dt
+	void emitFromSpawner(ParticleSpawner *spawner, int count);	// emit particles placed by a single spawner
+	void emitFromSpawners(float dt);	// emit what the spawners request by themselves, e.g. at events of another system
+	void generateParticles(int startId, int endId);				// run all generators on freshly spawned particles and make them alive
 
 public:
 	float	emitRate;	// Note: For a constant particle stream, it should hold that: emitRate <= (maximalParticleCount / averageParticleLifetime)
+	EmissionSchedule emissionSchedule;	// Bursts and rate curves, emitted together with emitRate in one batch per step
+	SpawnerDistribution spawnerDistribution;	// How new particles are split across the spawners
+
+	bool	fixedTimeStep;	// Simulate in steps of exactly timeStep and interpolate positions for rendering
+	float	timeStep;
+	int		maxSubSteps;	// Maximal number of steps per update, time that can't be caught up on is dropped
+
+	SortMode	sortMode;	// Draw order of the particles, sorting doesn't move the particle data
+	std::function<float(const ParticleData *, int)> sortKey;	// Key of particle i for SortByKey
+	int			maxThreads;	// Threads used to sort and build vertices of large systems, 1 to run on the calling thread only
+
+	bool		culling;				// Only build and draw particles that overlap the current view and are not transparent
+	sf::Uint8	cullAlphaThreshold;		// Particles with alpha at or below are culled
+
+	bool			analytic;				// Skip all updaters and evaluate particles in closed form from their spawn state while rendering
+	sf::Vector2f	analyticAcceleration;	// Constant acceleration used in analytic mode
 
 protected:
 	float m_dt;
+	float m_time;	// Total simulated time
+	float m_timeAccumulator;
+	float m_interpolation;	// Blend factor between prevPos and pos for rendering
+	float m_stepDt;			// Length of the current or last step
+	bool m_fixedStepActive;	// Last update ran in fixed steps, so prevPos holds the previous step
 
 	ParticleData *m_particles;
 	
@@ -91,7 +144,21 @@ protected:
 	std::vector<ParticleSpawner *> m_spawners;
 	std::vector<ParticleUpdater *> m_updaters;
 
+	AliasTable m_spawnerTable;
+	std::vector<float> m_spawnerWeights;	// Weights m_spawnerTable was built from
+	std::vector<int> m_spawnerCounts;
+
 	sf::VertexArray m_vertices;
+	bool m_verticesDirty;		// Set by every update, vertices are built at most once per update and view
+	bool m_verticesCulled;		// Last build was culled against m_cullCenter and m_cullExtent
+	sf::Vector2f m_cullCenter;
+	sf::Vector2f m_cullExtent;
+
+	const int *m_drawIndices;	// Particles in vertex order, nullptr if all alive particles are drawn in storage order
+	int m_drawCount;
+	std::vector<int> m_visible;
+	std::vector<float> m_sortKeys;
+	RadixSorter m_sorter;
 };
 
 
@@ -110,6 +177,14 @@ protected:
 };
 
 
+/* 16 instead of 20 bytes per vertex, texture coordinates are normalized to the full 16 bit range */
+struct CompactVertex {
+	sf::Vector2f position;
+	sf::Color color;
+	sf::Uint16 texCoords[2];
+};
+
+
 class TextureParticleSystem : public ParticleSystem {
 public:
 	TextureParticleSystem(int maxCount, sf::Texture *texture);
@@ -121,15 +196,40 @@ public:
 	virtual void render(sf::RenderTarget &renderTarget) override;
 
 	void setTexture(sf::Texture *texture);
+	inline sf::Texture *getTexture() const { return m_texture; }
 
 protected:
-	void updateVertices();
+	void prepareVertices(const sf::RenderTarget &renderTarget);	// cull and build unless the last build is still valid for renderTarget
+	virtual void updateVertices();
+	template<typename Vertex>
+	void buildVertices(Vertex *vertices, int begin, int end);	// quads for the draw slots [begin, end), safe to run concurrently on disjoint ranges
+	void drawVertices(sf::RenderTarget &renderTarget, bool additive);	// indexed triangles from the last build
+	static void setAdditiveBlending();	// sf::BlendAdd for raw OpenGL draws, alpha is summed as well
+
+	inline bool isBatched() const { return m_batchVertices != nullptr || m_batchCompactVertices != nullptr; }
+	inline bool usesCompactLayout() const { return isBatched() ? m_batchCompactVertices != nullptr : compactVertices; }
 
 public:
 	bool additiveBlendMode;
+	bool compactVertices;	// Build CompactVertex quads instead of sf::Vertex to cut the vertex data uploaded per frame
 
 protected:
 	sf::Texture *m_texture;
+	bool m_texCoordsCurrent;	// Vertex slot i holds the texture coordinates of particle i, used by SpriteSheetParticleSystem
+	bool m_texCoordsCompact;	// Vertex layout m_texCoordsCurrent refers to
+	bool m_verticesCompact;		// Vertex layout of the last build
+	std::vector<CompactVertex> m_compactVertices;	// Allocated when compactVertices is first used
+	std::vector<unsigned int> m_indices;			// Static triangle indices for maxCount quads
+
+	// Set while a ParticleBatch renders the system: quads are built straight into the batch's vertex range, whose
+	// texture coordinates are in atlas space, so they are moved by m_texCoordOffset and normalized to m_texCoordSpace
+	sf::Vertex *m_batchVertices;
+	CompactVertex *m_batchCompactVertices;
+	sf::Vector2f m_texCoordOffset;
+	sf::Vector2f m_texCoordSpace;
+
+	friend class ParticleBatch;
+	friend class MetaballLayer;
 };
 
 
@@ -144,28 +244,89 @@ public:
 	virtual void render(sf::RenderTarget &renderTarget) override;
 
 protected:
-	void updateVertices();
+	virtual void updateVertices() override;
 };
 
 
-class MetaballParticleSystem : public TextureParticleSystem {
+class MetaballParticleSystem;
+
+/* Accumulates the blobs of one or more metaball systems in an offscreen target and thresholds them in a single pass,
+   so overlapping systems merge and the full screen pass is only paid once */
+class MetaballLayer {
 public:
-	MetaballParticleSystem(int maxCount, sf::Texture *texture, int windowWidth, int windowHeight);
-	virtual ~MetaballParticleSystem() {}
+	MetaballLayer();
+	~MetaballLayer() {}
 
-	MetaballParticleSystem(const MetaballParticleSystem &) = delete;
-	MetaballParticleSystem &operator=(const MetaballParticleSystem &) = delete;
+	MetaballLayer(const MetaballLayer &) = delete;
+	MetaballLayer &operator=(const MetaballLayer &) = delete;
 
-	virtual void render(sf::RenderTarget &renderTarget) override;
+	void addSystem(MetaballParticleSystem *system);
+	void removeSystem(MetaballParticleSystem *system);
+	inline void clearSystems() { m_systems.clear(); }
+
+	void render(sf::RenderTarget &renderTarget);	// systems in a layer are only rendered through it
+
+	void resize(const sf::Vector2u &targetSize);	// size the offscreen target for a render target, no-op if it already fits
 
 public:
 	sf::Color color{ sf::Color::White };
 	float threshold{ 0.5f };
+	float resolutionScale{ 1.0f };	// Size of the offscreen target relative to the render target, below 1 cuts fill rate
 
 protected:
+	std::vector<MetaballParticleSystem *> m_systems;
 	sf::RenderTexture m_renderTexture;
 	sf::Sprite m_sprite;
 	sf::Shader m_shader;
 };
 
+
+class MetaballParticleSystem : public TextureParticleSystem {
+public:
+	MetaballParticleSystem(int maxCount, sf::Texture *texture, int windowWidth, int windowHeight);	// window size is unused, the own layer is created on the first render()
+	virtual ~MetaballParticleSystem();
+
+	MetaballParticleSystem(const MetaballParticleSystem &) = delete;
+	MetaballParticleSystem &operator=(const MetaballParticleSystem &) = delete;
+
+	virtual void render(sf::RenderTarget &renderTarget) override;	// through a layer of its own, see MetaballLayer for sharing one
+
+public:
+	sf::Color color{ sf::Color::White };
+	float threshold{ 0.5f };
+	float resolutionScale{ 1.0f };
+
+protected:
+	MetaballLayer *m_layer{ nullptr };	// Only created when drawn on its own, systems in a shared layer never allocate one
+};
+
+
+
+/* Renders every particle as a ribbon through its last historyLength positions. Vertices are rebuilt once per update
+   and sortMode orders the ribbons, culling is not supported since ribbons reach back over their history */
+class RibbonParticleSystem : public ParticleSystem {
+public:
+	RibbonParticleSystem(int maxCount, int historyLength, sf::Texture *texture = nullptr);
+	virtual ~RibbonParticleSystem() {}
+
+	RibbonParticleSystem(const RibbonParticleSystem &) = delete;
+	RibbonParticleSystem &operator=(const RibbonParticleSystem &) = delete;
+
+	virtual void update(const sf::Time &dt) override;
+	virtual void render(sf::RenderTarget &renderTarget) override;
+
+protected:
+	void captureHistory();
+	void updateVertices();
+
+	inline int getVerticesPerParticle() const { return 2 * m_particles->historyLength + 2; }
+
+public:
+	bool additiveBlendMode;
+
+protected:
+	sf::Texture *m_texture;		// Optional, stretched along the ribbon
+	std::vector<sf::Vector2f> m_points;
+};
+
 }
\ No newline at end of file
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace particles {
+
+/* Threads shared by all parallel loops, started on first use and kept waiting between jobs, so a loop costs a wake up
+   instead of thread creation. Jobs from different threads are run one after the other. */
+class WorkerPool {
+public:
+	static WorkerPool &instance() {
+		static WorkerPool pool;
+		return pool;
+	}
+
+	inline int getNumberThreads() const { return static_cast<int>(m_workers.size()) + 1; }	// workers and the calling thread
+
+	// Calls task(0) to task(count - 1) on the workers and the calling thread, returns when all calls are done
+	void run(int count, const std::function<void(int)> &task) {
+		if (count <= 1 || m_workers.empty()) {
+			for (int i = 0; i < count; ++i) task(i);
+			return;
+		}
+
+		std::lock_guard<std::mutex> job(m_jobMutex);
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_task = &task;
+			m_taskCount = count;
+			m_nextTask = 0;
+			m_pending = count;
+			m_generation++;
+		}
+		m_wake.notify_all();
+
+		work();
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_done.wait(lock, [this] { return m_pending == 0; });
+		m_task = nullptr;
+	}
+
+private:
+	WorkerPool() {
+		const int threads = std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+		for (int i = 1; i < threads; ++i) {
+			m_workers.emplace_back([this] { loop(); });
+		}
+	}
+
+	~WorkerPool() {
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+		}
+		m_wake.notify_all();
+
+		for (auto &worker : m_workers) {
+			worker.join();
+		}
+	}
+
+	WorkerPool(const WorkerPool &) = delete;
+	WorkerPool &operator=(const WorkerPool &) = delete;
+
+	void loop() {
+		unsigned int generation = 0;
+		for (;;) {
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_wake.wait(lock, [this, generation] { return m_stop || m_generation != generation; });
+				if (m_stop) return;
+				generation = m_generation;
+			}
+			work();
+		}
+	}
+
+	void work() {
+		for (;;) {
+			const std::function<void(int)> *task;
+			int i;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (m_nextTask >= m_taskCount) return;
+				task = m_task;
+				i = m_nextTask++;
+			}
+
+			(*task)(i);
+
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (--m_pending == 0) m_done.notify_all();
+		}
+	}
+
+private:
+	std::vector<std::thread> m_workers;
+	std::mutex m_jobMutex;
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::condition_variable m_done;
+	const std::function<void(int)> *m_task{ nullptr };
+	int m_taskCount{ 0 };
+	int m_nextTask{ 0 };
+	int m_pending{ 0 };
+	unsigned int m_generation{ 0 };
+	bool m_stop{ false };
+};
+
+
+/* Calls func(begin, end) for consecutive ranges of [0, count) on up to maxThreads threads of the WorkerPool, the calling
+   thread included. Every thread gets at least minCount items, func must not start another parallelFor */
+template<typename Func>
+inline void parallelFor(int count, int minCount, int maxThreads, Func func) {
+	int threads = std::min(maxThreads, count / std::max(minCount, 1));
+	if (threads <= 1) {
+		func(0, count);
+		return;
+	}
+
+	WorkerPool &pool = WorkerPool::instance();
+	threads = std::min(threads, pool.getNumberThreads());
+	const int chunk = (count + threads - 1) / threads;
+
+	pool.run(threads, [&func, chunk, count](int t) {
+		const int begin = t * chunk;
+		if (begin < count) func(begin, std::min(begin + chunk, count));
+	});
+}
+
+}
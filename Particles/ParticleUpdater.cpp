@@ -4,6 +4,19 @@
 #include "Particles/ParticleHelpers.h"
 
 namespace particles {
+
+static inline void expandBounds(sf::Vector2f &lo, sf::Vector2f &hi, const sf::Vector2f &from, const sf::Vector2f &to, const sf::Vector2f &next, float radius) {
+	lo.x = std::min(lo.x, std::min(from.x, std::min(to.x, next.x)) - radius);
+	lo.y = std::min(lo.y, std::min(from.y, std::min(to.y, next.y)) - radius);
+	hi.x = std::max(hi.x, std::max(from.x, std::max(to.x, next.x)) + radius);
+	hi.y = std::max(hi.y, std::max(from.y, std::max(to.y, next.y)) + radius);
+}
+
+static inline void storeBounds(ParticleData *data, const sf::Vector2f &lo, const sf::Vector2f &hi) {
+	data->boundsMin = lo;
+	data->boundsMax = hi;
+	data->boundsValid = true;
+}
 	
 void EulerUpdater::update(ParticleData *data, float dt) {
 	const int endId = data->countAlive;
@@ -12,17 +25,79 @@ void EulerUpdater::update(ParticleData *data, float dt) {
 		data->acc[i] += globalAcceleration;
 	}
 
+	sf::Vector2f lo(FLT_MAX, FLT_MAX), hi(-FLT_MAX, -FLT_MAX);
+
 	for (int i = 0; i < endId; ++i) {
-		data->pos[i] += dt * data->vel[i];
+		sf::Vector2f from = data->pos[i];
+		sf::Vector2f to = from + dt * data->vel[i];
+		sf::Vector2f next = to + dt * (data->vel[i] + dt * data->acc[i]);
+
+		data->pos[i] = to;
+		expandBounds(lo, hi, from, to, next, ParticleData::boundsExtent * data->size[i].x);
 	}
 
 	for (int i = 0; i < endId; ++i) {
 		data->vel[i] += dt * data->acc[i];
 	}
+
+	storeBounds(data, lo, hi);
+}
+
+
+void IntegratorUpdater::update(ParticleData *data, float dt) {
+	const int endId = data->countAlive;
+	const float halfDtSq = 0.5f * dt * dt;
+	const float globalDecay = std::exp(-damping * dt);
+	const float *particleDamping = data->damping;
+
+	// Bounds are reduced in the same pass: old and new position, plus one more step at the new velocity
+	sf::Vector2f lo(FLT_MAX, FLT_MAX), hi(-FLT_MAX, -FLT_MAX);
+
+	if (scheme == SemiImplicitEuler) {
+		for (int i = 0; i < endId; ++i) {
+			sf::Vector2f acc = data->acc[i] + globalAcceleration;
+			float decay = useParticleDamping ? std::exp(-particleDamping[i] * dt) : globalDecay;
+			sf::Vector2f vel = decay * (data->vel[i] + dt * acc);
+			sf::Vector2f from = data->pos[i];
+			sf::Vector2f to = from + dt * vel;
+
+			data->acc[i] = acc;
+			data->vel[i] = vel;
+			data->pos[i] = to;
+			expandBounds(lo, hi, from, to, to + dt * vel, ParticleData::boundsExtent * data->size[i].x);
+		}
+	}
+	else {
+		// Acceleration is only known at the current position, so the second half kick of the last step is applied here:
+		// v(t) = v(t - dt) + dt * (a(t - dt) + a(t)) / 2, then x(t + dt) = x(t) + dt * v(t) + dt^2 * a(t) / 2
+		const sf::Vector2f *prevAcc = data->prevAcc;
+
+		for (int i = 0; i < endId; ++i) {
+			sf::Vector2f acc = data->acc[i] + globalAcceleration;
+			float decay = useParticleDamping ? std::exp(-particleDamping[i] * dt) : globalDecay;
+			sf::Vector2f vel = data->vel[i];
+			if (prevAcc[i].x != FLT_MAX) {
+				vel = decay * (vel + (0.5f * dt) * (prevAcc[i] + acc));
+			}
+			sf::Vector2f from = data->pos[i];
+			sf::Vector2f to = from + dt * vel + halfDtSq * acc;
+
+			data->acc[i] = acc;
+			data->prevAcc[i] = acc;
+			data->pos[i] = to;
+			data->vel[i] = vel;
+			// vel lags a step behind pos, so the next step also covers the velocity gained in this one
+			expandBounds(lo, hi, from, to, to + dt * vel + (3.0f * halfDtSq) * acc, ParticleData::boundsExtent * data->size[i].x);
+		}
+	}
+
+	storeBounds(data, lo, hi);
 }
 
 
 void HorizontalCollisionUpdater::update(ParticleData *data, float dt) {
+	if (pos < data->boundsMin.x || pos > data->boundsMax.x) return;
+
 	const int endId = data->countAlive;
 
 	for (int i = 0; i < endId; ++i) {
@@ -37,12 +112,17 @@ void HorizontalCollisionUpdater::update(ParticleData *data, float dt) {
 
 			sf::Vector2f vel = data->vel[i];
 			data->vel[i] = sf::Vector2f(-vel.x * bounceFactor, vel.y);
+
+			data->expandBoundsMoved(i, dt);
+			data->addEvent(i, ParticleEvent::Collision);
 		}
 	}
 }
 
 
 void VerticalCollisionUpdater::update(ParticleData *data, float dt) {
+	if (pos < data->boundsMin.y || pos > data->boundsMax.y) return;
+
 	const int endId = data->countAlive;
 
 	for (int i = 0; i < endId; ++i) {
@@ -57,11 +137,244 @@ void VerticalCollisionUpdater::update(ParticleData *data, float dt) {
 
 			sf::Vector2f vel = data->vel[i];
 			data->vel[i] = sf::Vector2f(vel.x, -vel.y * bounceFactor);
+
+			data->expandBoundsMoved(i, dt);
+			data->addEvent(i, ParticleEvent::Collision);
 		}
 	}
 }
 
 
+void DynamicCollisionUpdater::clearColliders() {
+	m_colliders.clear();
+	m_gridDirty = true;
+}
+
+void DynamicCollisionUpdater::addCircle(const sf::Vector2f &center, float radius, const sf::Vector2f &vel) {
+	m_colliders.push_back({ center, sf::Vector2f(radius, radius), vel, true });
+	m_gridDirty = true;
+}
+
+void DynamicCollisionUpdater::addBox(const sf::FloatRect &box, const sf::Vector2f &vel) {
+	sf::Vector2f half{ 0.5f * box.width, 0.5f * box.height };
+	m_colliders.push_back({ sf::Vector2f(box.left + half.x, box.top + half.y), half, vel, false });
+	m_gridDirty = true;
+}
+
+void DynamicCollisionUpdater::buildGrid() {
+	m_gridDirty = false;
+	m_gridWidth = m_gridHeight = 0;
+
+	const int numColliders = static_cast<int>(m_colliders.size());
+	if (numColliders == 0) return;
+
+	sf::Vector2f lo = m_colliders[0].center - m_colliders[0].extent;
+	sf::Vector2f hi = m_colliders[0].center + m_colliders[0].extent;
+	m_maxColliderSpeed = 0.0f;
+	for (int j = 0; j < numColliders; ++j) {
+		const Collider &c = m_colliders[j];
+		lo.x = std::min(lo.x, c.center.x - c.extent.x);	lo.y = std::min(lo.y, c.center.y - c.extent.y);
+		hi.x = std::max(hi.x, c.center.x + c.extent.x);	hi.y = std::max(hi.y, c.center.y + c.extent.y);
+		m_maxColliderSpeed = std::max(m_maxColliderSpeed, std::max(std::abs(c.vel.x), std::abs(c.vel.y)));
+	}
+
+	float cell = std::max(cellSize, std::max(hi.x - lo.x, hi.y - lo.y) / std::max(maxGridSize, 1));
+	cell = std::max(cell, 1e-3f);
+
+	m_gridMin = lo;
+	m_invCellSize = 1.0f / cell;
+	m_gridWidth = static_cast<int>((hi.x - lo.x) * m_invCellSize) + 1;
+	m_gridHeight = static_cast<int>((hi.y - lo.y) * m_invCellSize) + 1;
+
+	// Counting sort of the colliders into all cells their bounding box overlaps
+	const int numCells = m_gridWidth * m_gridHeight;
+	m_cellStart.assign(numCells + 1, 0);
+
+	for (int pass = 0; pass < 2; ++pass) {
+		for (int j = 0; j < numColliders; ++j) {
+			const Collider &c = m_colliders[j];
+			int x0 = static_cast<int>((c.center.x - c.extent.x - lo.x) * m_invCellSize);
+			int y0 = static_cast<int>((c.center.y - c.extent.y - lo.y) * m_invCellSize);
+			int x1 = std::min(static_cast<int>((c.center.x + c.extent.x - lo.x) * m_invCellSize), m_gridWidth - 1);
+			int y1 = std::min(static_cast<int>((c.center.y + c.extent.y - lo.y) * m_invCellSize), m_gridHeight - 1);
+
+			for (int y = y0; y <= y1; ++y) {
+				for (int x = x0; x <= x1; ++x) {
+					int id = y * m_gridWidth + x;
+					if (pass == 0) {
+						m_cellStart[id]++;
+					}
+					else {
+						m_cellColliders[--m_cellStart[id]] = j;
+					}
+				}
+			}
+		}
+
+		if (pass == 0) {
+			// Turn counts into end offsets, the second pass moves them back to the start offsets
+			for (int id = 1; id < numCells; ++id) {
+				m_cellStart[id] += m_cellStart[id - 1];
+			}
+			m_cellStart[numCells] = m_cellStart[numCells - 1];
+			m_cellColliders.resize(m_cellStart[numCells]);
+		}
+	}
+}
+
+float DynamicCollisionUpdater::sweep(const Collider &c, const sf::Vector2f &pos, const sf::Vector2f &vel, float dt, sf::Vector2f &contact, sf::Vector2f &normal) const {
+	// In the collider's frame the collider stands still and the particle moves from r0 by d
+	const sf::Vector2f r0 = pos - c.center;
+	const sf::Vector2f d = dt * (vel - c.vel);
+
+	if (c.circle) {
+		const float radius = c.extent.x;
+		const float distSq = dot(r0, r0);
+
+		// Already inside, e.g. the collider was placed over the particle: push out along the center line
+		if (distSq < radius * radius) {
+			float dist = std::sqrt(distSq);
+			normal = (dist > 0.0f) ? r0 / dist : sf::Vector2f(0.0f, -1.0f);
+			contact = normal * radius;
+			return 0.0f;
+		}
+
+		// First root of |r0 + t * d| = radius
+		const float a = dot(d, d);
+		const float b = dot(r0, d);
+		if (a <= 0.0f || b >= 0.0f) return -1.0f;
+
+		const float disc = b * b - a * (distSq - radius * radius);
+		if (disc < 0.0f) return -1.0f;
+
+		const float t = (-b - std::sqrt(disc)) / a;
+		if (t > 1.0f) return -1.0f;
+
+		contact = r0 + t * d;
+		normal = contact / radius;
+		return t;
+	}
+
+	const sf::Vector2f e = c.extent;
+	if (std::abs(r0.x) < e.x && std::abs(r0.y) < e.y) {
+		// Already inside, leave the box through the closest side
+		contact = r0;
+		if (e.x - std::abs(r0.x) < e.y - std::abs(r0.y)) {
+			normal = sf::Vector2f(r0.x < 0.0f ? -1.0f : 1.0f, 0.0f);
+			contact.x = normal.x * e.x;
+		}
+		else {
+			normal = sf::Vector2f(0.0f, r0.y < 0.0f ? -1.0f : 1.0f);
+			contact.y = normal.y * e.y;
+		}
+		return 0.0f;
+	}
+
+	// Slab test, the segment enters the box when it is inside both slabs
+	float tEnter = 0.0f, tExit = 1.0f;
+	int enterAxis = -1;
+	const float r[2] = { r0.x, r0.y };
+	const float dir[2] = { d.x, d.y };
+	const float half[2] = { e.x, e.y };
+
+	for (int axis = 0; axis < 2; ++axis) {
+		if (dir[axis] == 0.0f) {
+			if (std::abs(r[axis]) >= half[axis]) return -1.0f;
+			continue;
+		}
+
+		float t0 = (-half[axis] - r[axis]) / dir[axis];
+		float t1 = (half[axis] - r[axis]) / dir[axis];
+		if (t0 > t1) std::swap(t0, t1);
+
+		if (t0 > tEnter) {
+			tEnter = t0;
+			enterAxis = axis;
+		}
+		tExit = std::min(tExit, t1);
+		if (tEnter > tExit) return -1.0f;
+	}
+	if (enterAxis < 0) return -1.0f;
+
+	contact = r0 + tEnter * d;
+	normal = (enterAxis == 0) ? sf::Vector2f(d.x < 0.0f ? 1.0f : -1.0f, 0.0f) : sf::Vector2f(0.0f, d.y < 0.0f ? 1.0f : -1.0f);
+	return tEnter;
+}
+
+void DynamicCollisionUpdater::bounce(const Collider &c, const sf::Vector2f &normal, sf::Vector2f &vel, sf::Vector2f &acc) const {
+	// Bounce relative to the collider's own movement
+	float velN = dot(vel - c.vel, normal);
+	if (velN < 0.0f) {
+		vel -= (1.0f + bounceFactor) * velN * normal;
+	}
+
+	float accN = dot(acc, normal);
+	if (accN < 0.0f) {
+		acc -= (1.0f + bounceFactor) * accN * normal;
+	}
+}
+
+void DynamicCollisionUpdater::update(ParticleData *data, float dt) {
+	if (m_gridDirty) {
+		buildGrid();
+	}
+	if (m_gridWidth == 0) return;
+
+	// Colliders can move into a particle from up to one step away
+	const sf::Vector2f reach(m_maxColliderSpeed * dt, m_maxColliderSpeed * dt);
+	const sf::Vector2f gridMax = m_gridMin + sf::Vector2f(static_cast<float>(m_gridWidth), static_cast<float>(m_gridHeight)) / m_invCellSize;
+	if (!data->boundsOverlap(m_gridMin - reach, gridMax + reach)) return;
+
+	const int endId = data->countAlive;
+
+	for (int i = 0; i < endId; ++i) {
+		const sf::Vector2f pos = data->pos[i];
+		const sf::Vector2f next = pos + dt * data->vel[i];
+
+		// Cells overlapped by the step, colliders spanning several of them are simply tested again
+		int x0 = static_cast<int>(std::floor((std::min(pos.x, next.x) - reach.x - m_gridMin.x) * m_invCellSize));
+		int y0 = static_cast<int>(std::floor((std::min(pos.y, next.y) - reach.y - m_gridMin.y) * m_invCellSize));
+		int x1 = static_cast<int>(std::floor((std::max(pos.x, next.x) + reach.x - m_gridMin.x) * m_invCellSize));
+		int y1 = static_cast<int>(std::floor((std::max(pos.y, next.y) + reach.y - m_gridMin.y) * m_invCellSize));
+		if (x1 < 0 || y1 < 0 || x0 >= m_gridWidth || y0 >= m_gridHeight) continue;
+
+		x0 = std::max(x0, 0);	x1 = std::min(x1, m_gridWidth - 1);
+		y0 = std::max(y0, 0);	y1 = std::min(y1, m_gridHeight - 1);
+
+		// The earliest hit wins
+		float hitTime = 2.0f;
+		int hit = -1;
+		sf::Vector2f hitContact, hitNormal;
+
+		for (int y = y0; y <= y1; ++y) {
+			for (int x = x0; x <= x1; ++x) {
+				const int cell = y * m_gridWidth + x;
+				for (int k = m_cellStart[cell]; k < m_cellStart[cell + 1]; ++k) {
+					const int j = m_cellColliders[k];
+					sf::Vector2f contact, normal;
+					float t = sweep(m_colliders[j], pos, data->vel[i], dt, contact, normal);
+					if (t >= 0.0f && t < hitTime) {
+						hitTime = t;
+						hit = j;
+						hitContact = contact;
+						hitNormal = normal;
+					}
+				}
+			}
+		}
+
+		if (hit < 0) continue;
+
+		// Move to where particle and collider meet, the next step starts from there with the new velocity
+		const Collider &c = m_colliders[hit];
+		data->pos[i] = c.center + (hitTime * dt) * c.vel + hitContact;
+		bounce(c, hitNormal, data->vel[i], data->acc[i]);
+		data->expandBoundsMoved(i, dt);
+		data->addEvent(i, ParticleEvent::Collision);
+	}
+}
+
+
 void AttractorUpdater::update(ParticleData *data, float dt) {
 	const int endId = data->countAlive;
 	int numAttractors = static_cast<int>(m_attractors.size());
@@ -81,6 +394,212 @@ void AttractorUpdater::update(ParticleData *data, float dt) {
 }
 
 
+void FlowFieldUpdater::resize(int width, int height) {
+	m_width = std::max(width, 1);
+	m_height = std::max(height, 1);
+	m_fieldX.assign(m_width * m_height, 0.0f);
+	m_fieldY.assign(m_width * m_height, 0.0f);
+	m_nextRow = 0;
+}
+
+void FlowFieldUpdater::loadFromImage(const sf::Image &image, float scale) {
+	sf::Vector2u size = image.getSize();
+	resize(static_cast<int>(size.x), static_cast<int>(size.y));
+
+	for (int y = 0; y < m_height; ++y) {
+		for (int x = 0; x < m_width; ++x) {
+			sf::Color c = image.getPixel(x, y);
+			m_fieldX[y * m_width + x] = scale * (c.r / 127.5f - 1.0f);
+			m_fieldY[y * m_width + x] = scale * (c.g / 127.5f - 1.0f);
+		}
+	}
+}
+
+void FlowFieldUpdater::generate(const std::function<sf::Vector2f(const sf::Vector2f &)> &func) {
+	for (int y = 0; y < m_height; ++y) {
+		for (int x = 0; x < m_width; ++x) {
+			sf::Vector2f v = func(origin + sf::Vector2f(x * cellSize, y * cellSize));
+			m_fieldX[y * m_width + x] = v.x;
+			m_fieldY[y * m_width + x] = v.y;
+		}
+	}
+}
+
+void FlowFieldUpdater::refresh() {
+	refreshRows(0, m_height);
+}
+
+void FlowFieldUpdater::refreshRows(int startRow, int endRow) {
+	if (!fieldFunction) return;
+
+	for (int y = startRow; y < endRow; ++y) {
+		for (int x = 0; x < m_width; ++x) {
+			sf::Vector2f v = fieldFunction(origin + sf::Vector2f(x * cellSize, y * cellSize), m_time);
+			m_fieldX[y * m_width + x] = v.x;
+			m_fieldY[y * m_width + x] = v.y;
+		}
+	}
+}
+
+void FlowFieldUpdater::update(ParticleData *data, float dt) {
+	if (m_width == 0) return;
+
+	m_time += dt;
+
+	// Amortize time dependent fields over several frames, one band of rows at a time
+	if (rowsPerFrame > 0 && fieldFunction) {
+		int rows = std::min(rowsPerFrame, m_height);
+		int endRow = std::min(m_nextRow + rows, m_height);
+		refreshRows(m_nextRow, endRow);
+		refreshRows(0, rows - (endRow - m_nextRow));
+		m_nextRow = (m_nextRow + rows) % m_height;
+	}
+
+	const int endId = data->countAlive;
+	const float invCellSize = 1.0f / cellSize;
+	const float *fieldX = m_fieldX.data();
+	const float *fieldY = m_fieldY.data();
+
+	if (mode == Force) {
+		for (int i = 0; i < endId; ++i) {
+			float gx = (data->pos[i].x - origin.x) * invCellSize;
+			float gy = (data->pos[i].y - origin.y) * invCellSize;
+			data->acc[i] += strength * sampleGrid(fieldX, fieldY, m_width, m_height, gx, gy, wrap);
+		}
+	}
+	else {
+		const float scale = strength * dt;
+		for (int i = 0; i < endId; ++i) {
+			float gx = (data->pos[i].x - origin.x) * invCellSize;
+			float gy = (data->pos[i].y - origin.y) * invCellSize;
+			data->pos[i] += scale * sampleGrid(fieldX, fieldY, m_width, m_height, gx, gy, wrap);
+			data->expandBoundsMoved(i, dt);
+		}
+	}
+}
+
+
+static float latticeValue(int x, int y, int slice, unsigned int seed) {
+	unsigned int h = seed;
+	h ^= static_cast<unsigned int>(x) * 0x8da6b343u;
+	h ^= static_cast<unsigned int>(y) * 0xd8163841u;
+	h ^= static_cast<unsigned int>(slice) * 0xcb1ab31fu;
+	h ^= h >> 13;	h *= 0x5bd1e995u;	h ^= h >> 15;
+	return (h & 0xffffff) / static_cast<float>(0x7fffff) - 1.0f;
+}
+
+void CurlNoiseUpdater::precompute() {
+	m_resolution = std::max(resolution, 2);
+	m_slices = std::max(slices, 1);
+	const int period = std::max(frequency, 1);
+	const int n = m_resolution;
+
+	std::vector<float> potential(n * n);
+	m_curlX.assign(m_slices * n * n, 0.0f);
+	m_curlY.assign(m_slices * n * n, 0.0f);
+
+	float maxLength = 0.0f;
+
+	for (int s = 0; s < m_slices; ++s) {
+		// Value noise on a lattice that wraps around with the tile, two octaves
+		for (int y = 0; y < n; ++y) {
+			for (int x = 0; x < n; ++x) {
+				float value = 0.0f;
+				float amplitude = 1.0f;
+
+				for (int octave = 0, p = period; octave < 2; ++octave, p *= 2, amplitude *= 0.5f) {
+					float lx = x * p / static_cast<float>(n);
+					float ly = y * p / static_cast<float>(n);
+					int x0 = static_cast<int>(lx);
+					int y0 = static_cast<int>(ly);
+					float fx = lx - x0;	fx = fx * fx * (3.0f - 2.0f * fx);
+					float fy = ly - y0;	fy = fy * fy * (3.0f - 2.0f * fy);
+					int x1 = (x0 + 1) % p;
+					int y1 = (y0 + 1) % p;
+					unsigned int octaveSeed = seed + 7919u * octave;
+
+					float v0 = lerpFloat(latticeValue(x0, y0, s, octaveSeed), latticeValue(x1, y0, s, octaveSeed), fx);
+					float v1 = lerpFloat(latticeValue(x0, y1, s, octaveSeed), latticeValue(x1, y1, s, octaveSeed), fx);
+					value += amplitude * lerpFloat(v0, v1, fy);
+				}
+
+				potential[y * n + x] = value;
+			}
+		}
+
+		// Curl of the scalar potential is (d/dy, -d/dx), which gives a divergence free field
+		float *curlX = &m_curlX[s * n * n];
+		float *curlY = &m_curlY[s * n * n];
+		for (int y = 0; y < n; ++y) {
+			for (int x = 0; x < n; ++x) {
+				float dx = potential[y * n + (x + 1) % n] - potential[y * n + (x + n - 1) % n];
+				float dy = potential[((y + 1) % n) * n + x] - potential[((y + n - 1) % n) * n + x];
+				curlX[y * n + x] = dy;
+				curlY[y * n + x] = -dx;
+				maxLength = std::max(maxLength, dx * dx + dy * dy);
+			}
+		}
+	}
+
+	// Normalize so that strength is the maximal magnitude of the field
+	if (maxLength > 0.0f) {
+		float invLength = 1.0f / std::sqrt(maxLength);
+		for (size_t i = 0; i < m_curlX.size(); ++i) {
+			m_curlX[i] *= invLength;
+			m_curlY[i] *= invLength;
+		}
+	}
+}
+
+void CurlNoiseUpdater::update(ParticleData *data, float dt) {
+	if (m_curlX.empty()) {
+		precompute();
+	}
+
+	m_time += dt;
+
+	const int endId = data->countAlive;
+	const int n = m_resolution;
+	const float toGrid = n / tileSize;
+
+	float t = m_time * speed;
+	t -= std::floor(t / m_slices) * m_slices;
+	const int s0 = std::min(static_cast<int>(t), m_slices - 1);
+	const int s1 = (s0 + 1) % m_slices;
+	const float blend = (m_slices > 1) ? t - s0 : 0.0f;
+
+	const float *x0 = &m_curlX[s0 * n * n];	const float *y0 = &m_curlY[s0 * n * n];
+	const float *x1 = &m_curlX[s1 * n * n];	const float *y1 = &m_curlY[s1 * n * n];
+	const float scale = (mode == FlowFieldUpdater::Force) ? strength : strength * dt;
+	const float scale0 = scale * (1.0f - blend);
+	const float scale1 = scale * blend;
+
+	sf::Vector2f *target = (mode == FlowFieldUpdater::Force) ? data->acc : data->pos;
+
+	if (m_slices == 1) {
+		for (int i = 0; i < endId; ++i) {
+			float gx = data->pos[i].x * toGrid;
+			float gy = data->pos[i].y * toGrid;
+			target[i] += scale * sampleGrid(x0, y0, n, n, gx, gy, true);
+		}
+	}
+	else {
+		for (int i = 0; i < endId; ++i) {
+			float gx = data->pos[i].x * toGrid;
+			float gy = data->pos[i].y * toGrid;
+			target[i] += scale0 * sampleGrid(x0, y0, n, n, gx, gy, true) + scale1 * sampleGrid(x1, y1, n, n, gx, gy, true);
+		}
+	}
+
+	// Advection moves particles, keep the bounds conservative for the updaters and culling that follow
+	if (mode != FlowFieldUpdater::Force) {
+		for (int i = 0; i < endId; ++i) {
+			data->expandBoundsMoved(i, dt);
+		}
+	}
+}
+
+
 void SizeUpdater::update(ParticleData *data, float dt) {
 	const int endId = data->countAlive;
 
@@ -121,6 +640,7 @@ void TimeUpdater::update(ParticleData *data, float dt) {
 		data->time[i].z = 1.0f - (data->time[i].x / data->time[i].y);
 
 		if (data->time[i].x < 0.0f) {
+			data->addEvent(i, ParticleEvent::Death);
 			data->kill(i);
 			endId = data->countAlive;
 		}
@@ -148,6 +668,7 @@ void AnimationUpdater::update(ParticleData *data, float dt) {
 			}
 			data->frame[i] = frame;
 			data->texCoords[i] = frames[frame];
+			data->texCoordsDirty[i] = true;
 		}
 
 		data->frameTimer[i] = currentTime;
@@ -2,6 +2,8 @@
 
 #include <SFML/Graphics.hpp>
 
+#include <functional>
+
 namespace particles {
 
 class ParticleData;
@@ -28,6 +30,27 @@ public:
 };
 
 
+/* Integrates velocity and position in a single pass with a selectable scheme and optional damping */
+class IntegratorUpdater : public ParticleUpdater {
+public:
+	enum Scheme {
+		SemiImplicitEuler,	// Update velocity first, then move with the new velocity
+		VelocityVerlet		// Second order, vel is completed with the average of the last and the current acceleration
+	};
+
+	IntegratorUpdater() {}
+	~IntegratorUpdater() {}
+
+	void update(ParticleData *data, float dt);
+
+public:
+	Scheme scheme{ SemiImplicitEuler };
+	sf::Vector2f globalAcceleration{ 0.0f, 0.0f };
+	float damping{ 0.0f };				// Exponential velocity damping per second for all particles
+	bool useParticleDamping{ false };	// Use the per particle damping set by DampingGenerator instead
+};
+
+
 class HorizontalCollisionUpdater : public ParticleUpdater {
 public:
 	HorizontalCollisionUpdater() {}
@@ -54,6 +77,54 @@ public:
 };
 
 
+/* Collision against moving circles and boxes that are re-submitted every frame.
+   Colliders are binned into a uniform grid so each particle only tests the colliders of the cells its next step sweeps.
+   The step is tested as a segment relative to the collider's movement, so fast particles don't tunnel through. */
+class DynamicCollisionUpdater : public ParticleUpdater {
+public:
+	DynamicCollisionUpdater() {}
+	~DynamicCollisionUpdater() {}
+
+	void update(ParticleData *data, float dt);
+
+	void clearColliders();
+	void addCircle(const sf::Vector2f &center, float radius, const sf::Vector2f &vel = sf::Vector2f(0.0f, 0.0f));
+	void addBox(const sf::FloatRect &box, const sf::Vector2f &vel = sf::Vector2f(0.0f, 0.0f));
+
+	size_t numColliders() const { return m_colliders.size(); }
+
+public:
+	float cellSize{ 64.0f };
+	float bounceFactor{ 0.5f };
+	int maxGridSize{ 256 };		// Maximal number of cells per axis, cells grow if the colliders span a larger area
+
+protected:
+	struct Collider {
+		sf::Vector2f center;
+		sf::Vector2f extent;	// x: radius for circles, half size for boxes
+		sf::Vector2f vel;
+		bool circle;
+	};
+
+	void buildGrid();
+	// Time of impact in [0, 1] of the particle's next step, negative if it misses. contact is relative to c.center
+	float sweep(const Collider &c, const sf::Vector2f &pos, const sf::Vector2f &vel, float dt, sf::Vector2f &contact, sf::Vector2f &normal) const;
+	void bounce(const Collider &c, const sf::Vector2f &normal, sf::Vector2f &vel, sf::Vector2f &acc) const;
+
+protected:
+	std::vector<Collider> m_colliders;
+	std::vector<int> m_cellStart;		// Offsets into m_cellColliders, one per cell plus one
+	std::vector<int> m_cellColliders;	// Collider indices, sorted by cell
+
+	sf::Vector2f m_gridMin;
+	float m_invCellSize{ 0.0f };
+	float m_maxColliderSpeed{ 0.0f };	// Particles look this far around their step for colliders moving into them
+	int m_gridWidth{ 0 };
+	int m_gridHeight{ 0 };
+	bool m_gridDirty{ true };
+};
+
+
 class AttractorUpdater : public ParticleUpdater {
 public:
 	AttractorUpdater() {}
@@ -70,6 +141,82 @@ protected:
 };
 
 
+/* Applies forces or velocities that are sampled bilinearly from a 2D vector grid */
+class FlowFieldUpdater : public ParticleUpdater {
+public:
+	enum Mode {
+		Force,		// Field is added to the particle acceleration
+		Velocity	// Particles are carried along the field on top of their own velocity
+	};
+
+	FlowFieldUpdater() {}
+	~FlowFieldUpdater() {}
+
+	void update(ParticleData *data, float dt);
+
+	void resize(int width, int height);
+	void loadFromImage(const sf::Image &image, float scale);	// Red and green channels map [0, 255] to [-scale, scale]
+	void generate(const std::function<sf::Vector2f(const sf::Vector2f &)> &func);	// Fill using a function of the world space cell position
+	void refresh();		// Fill the whole grid from fieldFunction at the current time
+
+	int getWidth() const { return m_width; }
+	int getHeight() const { return m_height; }
+	void setVector(int x, int y, const sf::Vector2f &v) { m_fieldX[y * m_width + x] = v.x; m_fieldY[y * m_width + x] = v.y; }
+	sf::Vector2f getVector(int x, int y) const { return { m_fieldX[y * m_width + x], m_fieldY[y * m_width + x] }; }
+
+public:
+	Mode mode{ Force };
+	sf::Vector2f origin{ 0.0f, 0.0f };	// World position of grid cell (0, 0)
+	float cellSize{ 32.0f };
+	float strength{ 1.0f };
+	bool wrap{ false };		// Repeat the field outside of the grid instead of clamping to the border
+
+	std::function<sf::Vector2f(const sf::Vector2f &, float)> fieldFunction;		// Optional time dependent field, evaluated at world position and time
+	int rowsPerFrame{ 0 };	// Number of grid rows re-evaluated from fieldFunction per update, 0 disables incremental updates
+
+protected:
+	void refreshRows(int startRow, int endRow);
+
+protected:
+	std::vector<float> m_fieldX;
+	std::vector<float> m_fieldY;
+	int m_width{ 0 };
+	int m_height{ 0 };
+	int m_nextRow{ 0 };
+	float m_time{ 0.0f };
+};
+
+
+/* Turbulence from a precomputed, tileable curl noise texture, optionally animated by blending between time slices */
+class CurlNoiseUpdater : public ParticleUpdater {
+public:
+	CurlNoiseUpdater() {}
+	~CurlNoiseUpdater() {}
+
+	void update(ParticleData *data, float dt);
+
+	void precompute();	// Has to be called again after changing resolution, frequency, slices or seed
+
+public:
+	FlowFieldUpdater::Mode mode{ FlowFieldUpdater::Force };
+	float tileSize{ 512.0f };	// World size covered by one repetition of the noise
+	float strength{ 100.0f };
+	float speed{ 1.0f };		// Time slices per second
+
+	int resolution{ 64 };		// Texels per tile side
+	int frequency{ 4 };			// Noise lattice cells per tile side
+	int slices{ 1 };			// Number of time slices, looped
+	unsigned int seed{ 0 };
+
+protected:
+	std::vector<float> m_curlX;		// One resolution x resolution plane per slice
+	std::vector<float> m_curlY;
+	int m_resolution{ 0 };
+	int m_slices{ 0 };
+	float m_time{ 0.0f };
+};
+
+
 class SizeUpdater : public ParticleUpdater {
 public:
 	SizeUpdater() {}
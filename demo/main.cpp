@@ -231,9 +231,19 @@ void gui() {
 		}
 
 		ImGui::SliderFloat("emit rate", &particleSystem->emitRate, 0.f, 1500.f);
+		ImGui::Checkbox("Fixed time step", &particleSystem->fixedTimeStep);
+		ImGui::Checkbox("Viewport culling", &particleSystem->culling);
+		const char* sortItems[] = { "None", "Oldest first", "Youngest first", "By y" };
+		static int sortItem = 0;
+		ImGui::Combo("Sort", &sortItem, sortItems, 4);
+		particleSystem->sortMode = static_cast<particles::ParticleSystem::SortMode>(sortItem);
+		if (ImGui::Checkbox("Analytic", &particleSystem->analytic)) {
+			particleSystem->reset();
+		}
 		if (particleSystemMode == ParticleSystemMode::Texture || particleSystemMode == ParticleSystemMode::Spritesheet || particleSystemMode == ParticleSystemMode::AnimatedSpritesheet) {
 			auto ps = dynamic_cast<particles::TextureParticleSystem *>(particleSystem);
 			ImGui::Checkbox("Additive blending", &ps->additiveBlendMode);
+			ImGui::Checkbox("Compact vertices", &ps->compactVertices);
 		}
 
 		if (particleSystemMode == ParticleSystemMode::Texture) {
@@ -258,6 +268,7 @@ void gui() {
 			auto ps = dynamic_cast<particles::MetaballParticleSystem *>(particleSystem);
 			ImGui::ColorEdit("Color", &ps->color);
 			ImGui::SliderFloat("Threshold", &ps->threshold, 0.f, 0.999f);
+			ImGui::SliderFloat("Resolution scale", &ps->resolutionScale, 0.1f, 1.f);
 		}
 	}
 
@@ -344,6 +355,9 @@ void gui() {
 		ImGui::SliderFloat2("gravity", &eulerUpdater->globalAcceleration, 0.f, 200.f);
 	}
 
+	// Also for freshly created systems and while the header is collapsed
+	particleSystem->analyticAcceleration = eulerUpdater->globalAcceleration;
+
 	ImGui::End();
 }
 